@@ -0,0 +1,173 @@
+#!/bin/sh
+
+BUILD='cc -Wall -Wundef -Wno-char-subscripts -Werror=implicit-function-declaration -funsigned-char -funsigned-char -I . -Os -ffunction-sections -fdata-sections -fno-asynchronous-unwind-tables -fno-strict-aliasing'
+
+FILES='lib/args.c
+lib/bunzip.c
+lib/deflate.c
+lib/dirtree.c
+lib/getmountlist.c
+lib/interestingtimes.c
+lib/lib.c
+lib/linestack.c
+lib/llist.c
+lib/net.c
+lib/password.c
+lib/portability.c
+lib/xwrap.c
+lib/xz.c lib/help.c main.c toys/lsb/dmesg.c
+toys/lsb/hostname.c
+toys/lsb/killall.c
+toys/lsb/md5sum.c
+toys/lsb/mknod.c
+toys/lsb/mktemp.c
+toys/lsb/mount.c
+toys/lsb/passwd.c
+toys/lsb/pidof.c
+toys/lsb/seq.c
+toys/lsb/su.c
+toys/lsb/sync.c
+toys/lsb/umount.c
+toys/net/ftpget.c
+toys/net/ifconfig.c
+toys/net/microcom.c
+toys/net/netcat.c
+toys/net/netstat.c
+toys/net/rfkill.c
+toys/net/tunctl.c
+toys/other/acpi.c
+toys/other/base64.c
+toys/other/blkid.c
+toys/other/blockdev.c
+toys/other/bzcat.c
+toys/other/chroot.c
+toys/other/chrt.c
+toys/other/chvt.c
+toys/other/clear.c
+toys/other/count.c
+toys/other/dos2unix.c
+toys/other/eject.c
+toys/other/factor.c
+toys/other/fallocate.c
+toys/other/flock.c
+toys/other/free.c
+toys/other/freeramdisk.c
+toys/other/fsfreeze.c
+toys/other/fsync.c
+toys/other/help.c
+toys/other/hexedit.c
+toys/other/hwclock.c
+toys/other/inotifyd.c
+toys/other/insmod.c
+toys/other/ionice.c
+toys/other/login.c
+toys/other/losetup.c
+toys/other/lsattr.c
+toys/other/lsmod.c
+toys/other/lspci.c
+toys/other/lsusb.c
+toys/other/makedevs.c
+toys/other/mix.c
+toys/other/mkpasswd.c
+toys/other/mkswap.c
+toys/other/modinfo.c
+toys/other/mountpoint.c
+toys/other/nbd_client.c
+toys/other/oneit.c
+toys/other/partprobe.c
+toys/other/pivot_root.c
+toys/other/pmap.c
+toys/other/printenv.c
+toys/other/pwdx.c
+toys/other/readahead.c
+toys/other/readlink.c
+toys/other/realpath.c
+toys/other/reboot.c
+toys/other/reset.c
+toys/other/rev.c
+toys/other/rmmod.c
+toys/other/setsid.c
+toys/other/shred.c
+toys/other/stat.c
+toys/other/swapoff.c
+toys/other/swapon.c
+toys/other/switch_root.c
+toys/other/sysctl.c
+toys/other/tac.c
+toys/other/taskset.c
+toys/other/timeout.c
+toys/other/truncate.c
+toys/other/uptime.c
+toys/other/usleep.c
+toys/other/vconfig.c
+toys/other/vmstat.c
+toys/other/w.c
+toys/other/which.c
+toys/other/xxd.c
+toys/other/yes.c
+toys/posix/basename.c
+toys/posix/cal.c
+toys/posix/cat.c
+toys/posix/chgrp.c
+toys/posix/chmod.c
+toys/posix/cksum.c
+toys/posix/cmp.c
+toys/posix/comm.c
+toys/posix/cp.c
+toys/posix/cpio.c
+toys/posix/cut.c
+toys/posix/date.c
+toys/posix/df.c
+toys/posix/dirname.c
+toys/posix/du.c
+toys/posix/echo.c
+toys/posix/env.c
+toys/posix/expand.c
+toys/posix/false.c
+toys/posix/file.c
+toys/posix/find.c
+toys/posix/grep.c
+toys/posix/head.c
+toys/posix/id.c
+toys/posix/kill.c
+toys/posix/link.c
+toys/posix/ln.c
+toys/posix/ls.c
+toys/posix/mkdir.c
+toys/posix/mkfifo.c
+toys/posix/nice.c
+toys/posix/nl.c
+toys/posix/nohup.c
+toys/posix/od.c
+toys/posix/paste.c
+toys/posix/patch.c
+toys/posix/printf.c
+toys/posix/ps.c
+toys/posix/pwd.c
+toys/posix/renice.c
+toys/posix/rm.c
+toys/posix/rmdir.c
+toys/posix/sed.c
+toys/posix/sleep.c
+toys/posix/sort.c
+toys/posix/split.c
+toys/posix/strings.c
+toys/posix/tail.c
+toys/posix/tee.c
+toys/posix/time.c
+toys/posix/touch.c
+toys/posix/true.c
+toys/posix/tty.c
+toys/posix/uname.c
+toys/posix/uniq.c
+toys/posix/unlink.c
+toys/posix/uudecode.c
+toys/posix/uuencode.c
+toys/posix/wc.c
+toys/posix/who.c
+toys/posix/xargs.c'
+
+LINK='-Wl,--gc-sections -o generated/unstripped/toybox -Wl,--as-needed -lutil -lcrypt -lm -lresolv -lrt -lcrypto -lz -lpthread'
+
+
+$BUILD $FILES $LINK
@@ -128,6 +128,17 @@ struct getoptflagstate
   unsigned excludes, requires;
 };
 
+// Name an option for error messages: "-c", or "--long" for long-only options.
+static char *opt_name(struct getoptflagstate *gof, struct opts *opt)
+{
+  struct longopts *lo;
+
+  if (opt->c != -1) return xmprintf("-%c", opt->c);
+  for (lo = gof->longopts; lo->opt != opt; lo = lo->next);
+
+  return xmprintf("--%.*s", lo->len, lo->str);
+}
+
 // Use getoptflagstate to parse parse one command line option from argv
 static int gotflag(struct getoptflagstate *gof, struct opts *opt)
 {
@@ -183,15 +194,7 @@ static int gotflag(struct getoptflagstate *gof, struct opts *opt)
 
     if (gof->nodash_now || (!arg[0] && !(opt->flags & 8)))
       arg = toys.argv[++gof->argc];
-    if (!arg) {
-      char *s = "Missing argument to ";
-      struct longopts *lo;
-
-      if (opt->c != -1) help_exit("%s-%c", s, opt->c);
-
-      for (lo = gof->longopts; lo->opt != opt; lo = lo->next);
-      help_exit("%s--%.*s", s, lo->len, lo->str);
-    }
+    if (!arg) help_exit("Missing argument to %s", opt_name(gof, opt));
 
     if (type == ':') *(opt->arg) = (long)arg;
     else if (type == '*') {
@@ -204,8 +207,10 @@ static int gotflag(struct getoptflagstate *gof, struct opts *opt)
     } else if (type == '#' || type == '-') {
       long l = atolx(arg);
       if (type == '-' && !ispunct(*arg)) l*=-1;
-      if (l < opt->val[0].l) help_exit("-%c < %ld", opt->c, opt->val[0].l);
-      if (l > opt->val[1].l) help_exit("-%c > %ld", opt->c, opt->val[1].l);
+      if (l < opt->val[0].l)
+        help_exit("%s < %ld", opt_name(gof, opt), opt->val[0].l);
+      if (l > opt->val[1].l)
+        help_exit("%s > %ld", opt_name(gof, opt), opt->val[1].l);
 
       *(opt->arg) = l;
     } else if (CFG_TOYBOX_FLOAT && type == '.') {
@@ -213,9 +218,9 @@ static int gotflag(struct getoptflagstate *gof, struct opts *opt)
 
       *f = strtod(arg, &arg);
       if (opt->val[0].l != LONG_MIN && *f < opt->val[0].f)
-        help_exit("-%c < %lf", opt->c, (double)opt->val[0].f);
+        help_exit("%s < %lf", opt_name(gof, opt), (double)opt->val[0].f);
       if (opt->val[1].l != LONG_MAX && *f > opt->val[1].f)
-        help_exit("-%c > %lf", opt->c, (double)opt->val[1].f);
+        help_exit("%s > %lf", opt_name(gof, opt), (double)opt->val[1].f);
     }
 
     if (!gof->nodash_now) gof->arg = "";
@@ -0,0 +1,971 @@
+/* deflate.c - deflate/inflate code for gzip and friends
+ *
+ * Copyright 2014 Rob Landley <rob@landley.net>
+ *
+ * See RFCs 1950 (zlib), 1951 (deflate), and 1952 (gzip)
+ *
+ * Both directions stream: gunzip_read() pulls decompressed data a buffer at a
+ * time and gzip_write() pushes data to compress, so callers like tar don't
+ * need a pipe to a child process.
+ */
+
+#include "toys.h"
+
+// little endian bit buffer
+struct bitbuf {
+  int fd, bitpos, len, max;
+  char buf[];
+};
+
+struct deflate {
+  struct bitbuf *bb;
+
+  // Huffman codes: base offset and extra bits tables (length and distance)
+  char lenbits[29], distbits[30];
+  unsigned short lenbase[29], distbase[30];
+  void *fixdisthuff, *fixlithuff, *lithuff, *disthuff;
+
+  // CRC, and the current gzip member's length and offset in the file
+  unsigned crc, *crc_table;
+  long long len, member;
+
+  // Compressed data buffer (for inflate, data[wrote] to data[pos] is
+  // waiting to be read)
+  char *data;
+  unsigned pos, end, wrote, block, stored;
+
+  // Inflate: block type we're in the middle of (0 none, 1 stored, 2 huffman),
+  // whether it's the last, and whether we're past the end of the stream.
+  char state, final, done;
+
+  // Deflate: tables and lazy matching state
+  unsigned short *hashhead, *hashchain, *symlen, *symdist;
+  int symcount, level, waiting, prevlen, prevdist;
+};
+
+// malloc a struct bitbuf (with 8 bytes of slack for bitbuf_peek)
+static struct bitbuf *bitbuf_init(int fd, int size)
+{
+  struct bitbuf *bb = xzalloc(sizeof(struct bitbuf)+size+8);
+
+  bb->max = size;
+  bb->fd = fd;
+
+  return bb;
+}
+
+// Advance bitpos without the overhead of recording bits
+static void bitbuf_skip(struct bitbuf *bb, int bits)
+{
+  int pos = bb->bitpos + bits, len = bb->len << 3;
+
+  while (pos >= len) {
+    pos -= len;
+    len = (bb->len = read(bb->fd, bb->buf, bb->max)) << 3;
+    if (bb->len < 1) perror_exit("inflate EOF");
+  }
+  bb->bitpos = pos;
+}
+
+// Move unread data to the start of the buffer and read more after it until
+// we have 8 bytes (or hit EOF), zeroing the 8 bytes after the end.
+static void bitbuf_fill(struct bitbuf *bb)
+{
+  int pos = bb->bitpos>>3, len;
+
+  memmove(bb->buf, bb->buf+pos, bb->len -= pos);
+  bb->bitpos &= 7;
+  while (bb->len < 8) {
+    if (1 > (len = read(bb->fd, bb->buf+bb->len, bb->max-bb->len))) break;
+    bb->len += len;
+  }
+  memset(bb->buf+bb->len, 0, 8);
+}
+
+// Return the next X (up to 32) bits from the bitbuf without consuming them,
+// with one 64 bit little endian load. Bits past EOF read as zero.
+static inline unsigned bitbuf_peek(struct bitbuf *bb, int bits)
+{
+  unsigned long long val;
+
+  if (bb->len-(bb->bitpos>>3) < 8) bitbuf_fill(bb);
+  memcpy(&val, bb->buf+(bb->bitpos>>3), 8);
+
+  return (SWAP_LE64(val)>>(bb->bitpos&7)) & ((1ULL<<bits)-1);
+}
+
+// Consume bits we peeked at
+static inline void bitbuf_drop(struct bitbuf *bb, int bits)
+{
+  if ((bb->bitpos += bits) > bb->len<<3) error_exit("inflate EOF");
+}
+
+// Fetch the next X bits from the bitbuf, little endian
+static unsigned bitbuf_get(struct bitbuf *bb, int bits)
+{
+  unsigned result = bitbuf_peek(bb, bits);
+
+  bitbuf_drop(bb, bits);
+
+  return result;
+}
+
+static void bitbuf_flush(struct bitbuf *bb)
+{
+  if (!bb->bitpos) return;
+
+  xwrite(bb->fd, bb->buf, (bb->bitpos+7)/8);
+  memset(bb->buf, 0, bb->max);
+  bb->bitpos = 0;
+}
+
+static void bitbuf_put(struct bitbuf *bb, int data, int len)
+{
+  while (len) {
+    int click = bb->bitpos >> 3, blow, blen;
+
+    // Flush buffer if necessary
+    if (click == bb->max) {
+      bitbuf_flush(bb);
+      click = 0;
+    }
+    blow = bb->bitpos & 7;
+    blen = 8-blow;
+    if (blen > len) blen = len;
+    bb->buf[click] |= data << blow;
+    bb->bitpos += blen;
+    data >>= blen;
+    len -= blen;
+  }
+}
+
+// Huffman coding uses bits to traverse a binary tree to a leaf node,
+// By placing frequently occurring symbols at shorter paths, frequently
+// used symbols may be represented in fewer bits than uncommon symbols.
+
+// Codes up to HUFF_FAST bits long decode with one lookup in fast[], indexed
+// by the next HUFF_FAST bits of input: symbol<<4 | code length, or 0 for a
+// longer code. Those get walked one length at a time using first[] (first
+// code of each length) and index[] (its position in symbol[]).
+#define HUFF_FAST 9
+
+struct huff {
+  unsigned short length[16];
+  unsigned short symbol[288];
+  unsigned short fast[1<<HUFF_FAST], first[16], index[16];
+};
+
+// Create simple huffman tree from array of bit lengths.
+
+// The symbols in the huffman trees are sorted (first by bit length
+// of the code to reach them, then by symbol number). This means that given
+// the bit length of each symbol, we can construct a unique tree.
+static void len2huff(struct huff *huff, char bitlen[], int len)
+{
+  int offset[16];
+  int i, j, k, n, code, rev;
+
+  // Count number of codes at each bit length
+  memset(huff, 0, sizeof(struct huff));
+  for (i = 0; i<len; i++) huff->length[bitlen[i]]++;
+
+  // Sort symbols by bit length. (They'll remain sorted by symbol within that.)
+  *huff->length = *offset = 0;
+  for (i = 1; i<16; i++) offset[i] = offset[i-1] + huff->length[i-1];
+
+  for (i = 0; i<len; i++) if (bitlen[i]) huff->symbol[offset[bitlen[i]]++] = i;
+
+  // Walk the codes in order, filling out every fast[] entry each short one
+  // is a (bit reversed) prefix of.
+  memset(huff->fast, 0, sizeof(huff->fast));
+  for (code = j = 0, i = 1; i<16; i++, code <<= 1) {
+    huff->first[i] = code;
+    huff->index[i] = j;
+    for (k = huff->length[i]; k--; code++, j++) {
+      if (i > HUFF_FAST) continue;
+      for (rev = n = 0; n<i; n++) rev |= ((code>>n)&1)<<(i-1-n);
+      for (; rev < 1<<HUFF_FAST; rev += 1<<i)
+        huff->fast[rev] = (huff->symbol[j]<<4) | i;
+    }
+  }
+}
+
+// Fetch and decode next huffman coded symbol from bitbuf.
+static unsigned huff_and_puff(struct bitbuf *bb, struct huff *huff)
+{
+  unsigned bits = bitbuf_peek(bb, 15), sym = huff->fast[bits&((1<<HUFF_FAST)-1)];
+  int i, code;
+
+  if (sym) {
+    bitbuf_drop(bb, sym&15);
+
+    return sym>>4;
+  }
+
+  // Long code: huffman codes are sent most significant bit first, so build
+  // it up a bit at a time until it's in range for its length.
+  for (i = code = 0; i<15;) {
+    code = (code<<1) | ((bits>>i++)&1);
+    if ((unsigned)(code-huff->first[i]) < huff->length[i]) {
+      bitbuf_drop(bb, i);
+
+      return huff->symbol[huff->index[i]+code-huff->first[i]];
+    }
+  }
+  error_exit("bad symbol");
+}
+
+// Order code length code lengths are stored in (RFC 1951 section 3.2.7)
+static char *hufflen_order = "\x10\x11\x12\0\x08\x07\x09\x06\x0a\x05\x0b"
+                             "\x04\x0c\x03\x0d\x02\x0e\x01\x0f";
+
+// Read the header of the next deflate block, and its huffman tables.
+static void inflate_block(struct deflate *dd)
+{
+  struct bitbuf *bb = dd->bb;
+  int type;
+
+  dd->final = bitbuf_get(bb, 1);
+  type = bitbuf_get(bb, 2);
+
+  if (type == 3) error_exit("bad type");
+
+  // Uncompressed block?
+  if (!type) {
+    int len, nlen;
+
+    // Align to byte, read length
+    bitbuf_skip(bb, (8-bb->bitpos)&7);
+    len = bitbuf_get(bb, 16);
+    nlen = bitbuf_get(bb, 16);
+    if (len != (0xffff & ~nlen)) error_exit("bad len");
+    dd->stored = len;
+    dd->state = 1;
+
+    return;
+  }
+
+  // Dynamic huffman codes?
+  if (type == 2) {
+    struct huff *h2 = ((struct huff *)dd->fixlithuff)+2;
+    int i, litlen, distlen, hufflen;
+    char bits[288+32];
+
+    // The huffman trees are stored as a series of bit lengths
+    litlen = bitbuf_get(bb, 5)+257;  // max 288
+    distlen = bitbuf_get(bb, 5)+1;   // max 32
+    hufflen = bitbuf_get(bb, 4)+4;   // max 19
+
+    // The literal and distance codes are themselves compressed, in
+    // a complicated way: an array of bit lengths (hufflen many
+    // entries, each 3 bits) is used to fill out an array of 19 entries
+    // in a magic order, leaving the rest 0. Then make a tree out of it:
+    memset(bits, 0, 19);
+    for (i=0; i<hufflen; i++) bits[hufflen_order[i]] = bitbuf_get(bb, 3);
+    len2huff(h2, bits, 19);
+
+    // Use that tree to read in the literal and distance bit lengths
+    for (i = 0; i < litlen + distlen;) {
+      int sym = huff_and_puff(bb, h2);
+
+      // 0-15 are literals, 16 = repeat previous code 3-6 times,
+      // 17 = 3-10 zeroes (3 bit), 18 = 11-138 zeroes (7 bit)
+      if (sym < 16) bits[i++] = sym;
+      else {
+        int len = sym & 2;
+
+        len = bitbuf_get(bb, sym-14+len+(len>>1)) + 3 + (len<<2);
+        if (i+len > litlen+distlen || (sym == 16 && !i))
+          error_exit("bad tree");
+        memset(bits+i, bits[i-1] * !(sym&3), len);
+        i += len;
+      }
+    }
+
+    len2huff(dd->lithuff = h2, bits, litlen);
+    len2huff(dd->disthuff = ((struct huff *)dd->fixlithuff)+3, bits+litlen,
+      distlen);
+
+  // Static huffman codes
+  } else {
+    dd->lithuff = dd->fixlithuff;
+    dd->disthuff = dd->fixdisthuff;
+  }
+  dd->state = 2;
+}
+
+// Decompress deflated data into dd->data until there's 64k of it (back
+// references reach 32k, so the caller has to slide down the window once it's
+// read that) or the last block ends.
+static void inflate_more(struct deflate *dd)
+{
+  struct bitbuf *bb = dd->bb;
+
+  while (dd->pos < 65536) {
+    if (!dd->state) {
+      if (dd->final) {
+        dd->done = 1;
+        break;
+      }
+      inflate_block(dd);
+    }
+
+    // Dump literal output data
+    if (dd->state == 1) {
+      int pos = bb->bitpos >> 3, bblen = bb->len - pos;
+
+      if (!dd->stored) {
+        dd->state = 0;
+        continue;
+      }
+
+      // copy bytes until done or end of current bitbuf contents or window
+      if (!bblen) {
+        bitbuf_skip(bb, 0);
+        continue;
+      }
+      if (bblen > dd->stored) bblen = dd->stored;
+      if (bblen > 65536-dd->pos) bblen = 65536-dd->pos;
+      memcpy(dd->data+dd->pos, bb->buf+pos, bblen);
+      bitbuf_drop(bb, bblen << 3);
+      dd->pos += bblen;
+      dd->stored -= bblen;
+
+    // Use huffman tables to decode block of compressed symbols
+    } else while (dd->pos < 65536) {
+      int sym = huff_and_puff(bb, dd->lithuff);
+
+      // Literal?
+      if (sym < 256) dd->data[dd->pos++] = sym;
+
+      // Copy range? Overlapping copies repeat the last dist bytes, so
+      // copy those a chunk at a time. (There's 512 bytes of slack after
+      // 64k for a match starting just before it.)
+      else if (sym > 256) {
+        char *out = dd->data+dd->pos;
+        int len, dist, n;
+
+        if ((sym -= 257) > 28) error_exit("bad symbol");
+        len = dd->lenbase[sym] + bitbuf_get(bb, dd->lenbits[sym]);
+        if ((sym = huff_and_puff(bb, dd->disthuff)) > 29)
+          error_exit("bad symbol");
+        dist = dd->distbase[sym] + bitbuf_get(bb, dd->distbits[sym]);
+        if (dist > dd->pos) error_exit("bad distance");
+
+        for (dd->pos += len; len; len -= n, out += n)
+          memcpy(out, out-dist, n = len<dist ? len : dist);
+
+      // End of block
+      } else {
+        dd->state = 0;
+        break;
+      }
+    }
+  }
+}
+
+// Deflate tuning for levels 1-9 (same numbers as zlib): search a quarter as
+// many hash links once we have a match of "good" length, don't look for a
+// better match at the next byte once we have "lazy" (0 = never look, just
+// take the first match), stop at "nice", and follow at most "chain" links.
+static struct deflate_level {
+  unsigned short good, lazy, nice, chain;
+} deflate_levels[] = {{4, 0, 8, 4}, {4, 0, 16, 8}, {4, 0, 32, 32},
+  {4, 4, 16, 16}, {8, 16, 32, 32}, {8, 16, 128, 128}, {8, 32, 128, 256},
+  {32, 128, 258, 1024}, {32, 258, 258, 4096}};
+
+// Symbols buffered per block before we pick huffman codes and write it out
+#define DEFLATE_SYMS 16384
+
+// Calculate huffman code lengths for symbol frequencies, no longer than max.
+// If the tree gets too deep, flatten the frequencies and try again.
+static void huff_lengths(unsigned *freq, char *bits, int len, int max)
+{
+  unsigned f[288], weight[576];
+  int sym[288], parent[576], i, j, k, count, leaf, node, over;
+
+  memcpy(f, freq, len*sizeof(*f));
+
+  // A usable code needs at least two symbols.
+  for (i = count = 0; i<len; i++) count += !!f[i];
+  for (i = 0; count<2; i++) if (!f[i]) f[i] = ++count;
+
+  for (;;) {
+    // Sort used symbols by frequency.
+    for (count = i = 0; i<len; i++) {
+      if (!f[i]) continue;
+      for (j = count++; j && f[sym[j-1]] > f[i]; j--) sym[j] = sym[j-1];
+      sym[j] = i;
+    }
+
+    // Merge the two lightest leaves or nodes until one node is left. Nodes
+    // are created in ascending weight order, so two queues do it.
+    for (i = 0; i<count; i++) weight[i] = f[sym[i]];
+    for (leaf = 0, node = k = count; k < 2*count-1; k++) {
+      for (j = 0; j<2; j++) {
+        i = (leaf<count && (node>=k || weight[leaf]<=weight[node]))
+          ? leaf++ : node++;
+        parent[i] = k;
+        weight[k] = j ? weight[k]+weight[i] : weight[i];
+      }
+    }
+
+    // Replace weights with depths, root first, and check the leaves.
+    weight[2*count-2] = 0;
+    for (k = 2*count-3; k>=0; k--) weight[k] = weight[parent[k]]+1;
+    memset(bits, 0, len);
+    for (i = over = 0; i<count; i++)
+      if ((bits[sym[i]] = weight[i]) > max) over++;
+    if (!over) return;
+
+    for (i = 0; i<len; i++) f[i] = (f[i]+1)/2;
+  }
+}
+
+// Assign canonical huffman codes to bit lengths, bit reversed because
+// deflate sends codes most significant bit first into a little endian stream.
+static void huff_codes(char *bits, unsigned short *codes, int len)
+{
+  unsigned short count[16], next[16];
+  int i, j, code;
+
+  memset(count, 0, sizeof(count));
+  for (i = 0; i<len; i++) count[bits[i]]++;
+  for (*count = code = 0, i = 1; i<16; i++)
+    next[i] = code = (code+count[i-1])<<1;
+  for (i = 0; i<len; i++) {
+    if (!bits[i]) continue;
+    for (code = next[bits[i]]++, codes[i] = j = 0; j<bits[i]; j++, code >>= 1)
+      codes[i] = (codes[i]<<1)|(code&1);
+  }
+}
+
+// Length code (0-28) for a match length 3-258
+static int deflate_lencode(int len)
+{
+  int i;
+
+  if ((len -= 3) < 8) return len;
+  if (len == 255) return 28;
+  for (i = 3; len>>(i+1); i++);
+
+  return 4*(i-1)+((len>>(i-2))&3);
+}
+
+// Distance code (0-29) for a match distance 1-32768
+static int deflate_distcode(int dist)
+{
+  int i;
+
+  if (--dist < 4) return dist;
+  for (i = 2; dist>>(i+1); i++);
+
+  return 2*i+((dist>>(i-1))&1);
+}
+
+// Write out buffered symbols covering input data[start] to data[end] as one
+// block, using whichever of stored, fixed, or dynamic huffman is smallest.
+static void deflate_block(struct deflate *dd, unsigned start, unsigned end,
+  int final)
+{
+  struct bitbuf *bb = dd->bb;
+  unsigned litfreq[288], distfreq[32], cfreq[19], stored, fixed, dynamic,
+    extra;
+  unsigned short litcode[288], distcode[32], ccode[19];
+  char litbits[288], dbits[32], fixbits[288], cbits[19], all[286+30],
+    rle[286+30], rlex[286+30], *data = dd->data;
+  int i, j, n, hlit, hdist, hclen, rlen;
+
+  // Count symbol frequencies and the extra bits they carry.
+  memset(litfreq, 0, sizeof(litfreq));
+  memset(distfreq, 0, sizeof(distfreq));
+  for (i = extra = 0; i<dd->symcount; i++) {
+    if (!dd->symdist[i]) litfreq[dd->symlen[i]]++;
+    else {
+      litfreq[257+(j = deflate_lencode(dd->symlen[i]))]++;
+      extra += dd->lenbits[j];
+      distfreq[j = deflate_distcode(dd->symdist[i])]++;
+      extra += dd->distbits[j];
+    }
+  }
+  litfreq[256] = 1;
+
+  huff_lengths(litfreq, litbits, 286, 15);
+  huff_lengths(distfreq, dbits, 30, 15);
+  for (hlit = 286; hlit>257 && !litbits[hlit-1]; hlit--);
+  for (hdist = 30; hdist>1 && !dbits[hdist-1]; hdist--);
+
+  // Run length encode the literal and distance code lengths together:
+  // 16 = repeat previous 3-6 times, 17 = 3-10 zeroes, 18 = 11-138 zeroes.
+  memcpy(all, litbits, hlit);
+  memcpy(all+hlit, dbits, hdist);
+  for (i = rlen = 0; i<hlit+hdist; i += n) {
+    for (n = 1; i+n<hlit+hdist && all[i+n]==all[i]; n++);
+    if (!all[i] && n>=3) {
+      if (n > 138) n = 138;
+      rle[rlen] = n>10 ? 18 : 17;
+      rlex[rlen++] = n - (n>10 ? 11 : 3);
+    } else if (all[i] && n>=4) {
+      if (n > 7) n = 7;
+      rle[rlen++] = all[i];
+      rle[rlen] = 16;
+      rlex[rlen++] = n-4;
+    } else rle[rlen++] = all[i], n = 1;
+  }
+  memset(cfreq, 0, sizeof(cfreq));
+  for (i = 0; i<rlen; i++) cfreq[rle[i]]++;
+  huff_lengths(cfreq, cbits, 19, 7);
+  for (hclen = 19; hclen>4 && !cbits[hufflen_order[hclen-1]]; hclen--);
+
+  // Work out the size of each block type. (Extra bits cost the same in both
+  // huffman types, so add them afterwards.)
+  for (i = 0; i<288; i++)
+    fixbits[i] = 8 + (i>143) - ((i>255)<<1) + (i>279);
+  dynamic = 14 + 3*hclen;
+  for (i = fixed = 0; i<286; i++) {
+    fixed += litfreq[i]*fixbits[i];
+    dynamic += litfreq[i]*litbits[i];
+  }
+  for (i = 0; i<30; i++) {
+    fixed += distfreq[i]*5;
+    dynamic += distfreq[i]*dbits[i];
+  }
+  for (i = 0; i<rlen; i++)
+    dynamic += cbits[rle[i]] + (rle[i]>15 ? "\2\3\7"[rle[i]-16] : 0);
+  stored = 32 + 8*(end-start) + ((8-((bb->bitpos+3)&7))&7);
+
+  bitbuf_put(bb, final, 1);
+  if (stored < extra+(fixed<dynamic ? fixed : dynamic) && end-start < 65536) {
+    bitbuf_put(bb, 0, 2);
+    bitbuf_put(bb, 0, (8-bb->bitpos)&7);
+    bitbuf_put(bb, end-start, 16);
+    bitbuf_put(bb, 0xffff & ~(end-start), 16);
+    while (start<end) bitbuf_put(bb, data[start++], 8);
+    dd->symcount = 0;
+
+    return;
+  }
+
+  if (fixed <= dynamic) {
+    bitbuf_put(bb, 1, 2);
+    memcpy(litbits, fixbits, 288);
+    memset(dbits, 5, 32);
+    hlit = 288;
+    hdist = 32;
+  } else {
+    bitbuf_put(bb, 2, 2);
+    bitbuf_put(bb, hlit-257, 5);
+    bitbuf_put(bb, hdist-1, 5);
+    bitbuf_put(bb, hclen-4, 4);
+    for (i = 0; i<hclen; i++) bitbuf_put(bb, cbits[hufflen_order[i]], 3);
+    huff_codes(cbits, ccode, 19);
+    for (i = 0; i<rlen; i++) {
+      bitbuf_put(bb, ccode[rle[i]], cbits[rle[i]]);
+      if (rle[i]>15) bitbuf_put(bb, rlex[i], "\2\3\7"[rle[i]-16]);
+    }
+  }
+  huff_codes(litbits, litcode, hlit);
+  huff_codes(dbits, distcode, hdist);
+
+  // Write the symbols
+  for (i = 0; i<dd->symcount; i++) {
+    int len = dd->symlen[i], dist = dd->symdist[i];
+
+    if (!dist) bitbuf_put(bb, litcode[len], litbits[len]);
+    else {
+      j = deflate_lencode(len);
+      bitbuf_put(bb, litcode[257+j], litbits[257+j]);
+      bitbuf_put(bb, len-dd->lenbase[j], dd->lenbits[j]);
+      j = deflate_distcode(dist);
+      bitbuf_put(bb, distcode[j], dbits[j]);
+      bitbuf_put(bb, dist-dd->distbase[j], dd->distbits[j]);
+    }
+  }
+  bitbuf_put(bb, litcode[256], litbits[256]);
+  dd->symcount = 0;
+}
+
+// Add the 3 bytes at data[pos] to the hash chains, returning the previous
+// (earlier) position with the same hash, or 0 for none.
+static unsigned deflate_insert(struct deflate *dd, unsigned pos)
+{
+  unsigned char *s = (void *)(dd->data+pos);
+  unsigned hash = ((s[0]<<10)^(s[1]<<5)^s[2])&32767, old = dd->hashhead[hash];
+
+  dd->hashchain[pos&32767] = old;
+  dd->hashhead[hash] = pos;
+
+  return old;
+}
+
+// Search the hash chain starting at cand for the longest match of data[pos]
+// (with avail bytes left), returning its length if it beats prev.
+static int deflate_match(struct deflate *dd, unsigned pos, unsigned cand,
+  int prev, int avail, int *dist)
+{
+  struct deflate_level *dl = deflate_levels+dd->level-1;
+  unsigned char *data = (void *)dd->data, *s = data+pos, *c;
+  unsigned limit = pos>32767 ? pos-32767 : 0;
+  int chain = dl->chain, nice = dl->nice, best = prev<2 ? 2 : prev, len;
+
+  if (avail > 258) avail = 258;
+  if (nice > avail) nice = avail;
+  if (best >= avail) return 0;
+  if (prev >= dl->good) chain >>= 2;
+
+  // Positions within the last 32k have unique hashchain slots, so following
+  // links stays on this chain until we pass the limit.
+  for (; cand>limit && chain--; cand = dd->hashchain[cand&32767]) {
+    c = data+cand;
+    if (c[best] != s[best] || *c != *s) continue;
+    for (len = 1; len<avail && c[len]==s[len]; len++);
+    if (len > best) {
+      best = len;
+      *dist = pos-cand;
+      if (len >= nice) break;
+    }
+  }
+
+  // A far away 3 byte match costs more than 3 literals.
+  if (best == 3 && *dist > 4096) return 0;
+
+  return best>prev && best>2 ? best : 0;
+}
+
+static void deflate_sym(struct deflate *dd, unsigned len, unsigned dist)
+{
+  dd->symlen[dd->symcount] = len;
+  dd->symdist[dd->symcount++] = dist;
+}
+
+// Compress buffered input with LZ77 matches found through hash chains over a
+// 64k buffer (the 32k window plus 32k of input), stopping when there isn't
+// enough lookahead left for a full length match unless this is the end.
+// With lazy matching, a match found at pos isn't used until we've checked
+// pos+1 doesn't have a longer one, so "waiting" means data[pos-1] is pending.
+static void deflate_more(struct deflate *dd, int final)
+{
+  struct deflate_level *dl = deflate_levels+dd->level-1;
+  unsigned char *data = (void *)dd->data;
+  unsigned pos = dd->pos, end = dd->end, avail, i;
+  int len, dist = 0;
+
+  for (;;) {
+    if (!final && end-pos < 262) break;
+    if (dd->symcount >= DEFLATE_SYMS-2) {
+      deflate_block(dd, dd->block, pos-dd->waiting, 0);
+      dd->block = pos-dd->waiting;
+    }
+
+    if (!(avail = end-pos) && !dd->waiting) break;
+    len = 0;
+    if (avail >= 3) {
+      i = deflate_insert(dd, pos);
+      if (!dl->lazy || dd->prevlen < dl->lazy)
+        len = deflate_match(dd, pos, i, dl->lazy ? dd->prevlen : 0, avail,
+          &dist);
+    }
+
+    // Greedy: take any match we find.
+    if (!dl->lazy) {
+      if (len) {
+        deflate_sym(dd, len, dist);
+        while (--len) if (end-++pos >= 3) deflate_insert(dd, pos);
+      } else deflate_sym(dd, data[pos], 0);
+      pos++;
+
+    // Lazy: if the match waiting at pos-1 is at least as good, use it.
+    } else if (dd->prevlen && len <= dd->prevlen) {
+      deflate_sym(dd, dd->prevlen, dd->prevdist);
+      for (i = dd->prevlen-2; i--;) if (end-++pos >= 3) deflate_insert(dd, pos);
+      pos++;
+      dd->waiting = dd->prevlen = 0;
+    } else {
+      if (dd->waiting) deflate_sym(dd, data[pos-1], 0);
+      dd->prevlen = len;
+      dd->prevdist = dist;
+      if (!avail) break;
+      dd->waiting = 1;
+      pos++;
+    }
+  }
+  dd->pos = pos;
+  if (final) {
+    deflate_block(dd, dd->block, pos, 1);
+    bitbuf_flush(dd->bb);
+  }
+}
+
+// Allocate memory and tables for deflate/inflate.
+static struct deflate *init_deflate(int compress)
+{
+  struct deflate *dd = xzalloc(sizeof(struct deflate));
+  int i, n = 1;
+
+  // compress needs 64k data, 32k entries each for hashhead and hashchain,
+  // and a block's worth of buffered symbols. decompress needs 64k data plus
+  // room for a max length match past that, then fixed and dynamic tables.
+  dd->data = xmalloc(compress ? 32768*8 : 65536+512+4*sizeof(struct huff));
+  if (compress) {
+    dd->hashhead = (unsigned short *)(dd->data + 65536);
+    dd->hashchain = dd->hashhead + 32768;
+    dd->symlen = dd->hashchain + 32768;
+    dd->symdist = dd->symlen + DEFLATE_SYMS;
+    memset(dd->hashhead, 0, 32768*sizeof(*dd->hashhead));
+  }
+
+  // Little endian slice-by-8 crc tables for gzip
+  crc_init8(dd->crc_table = xmalloc(8*256*sizeof(unsigned)), 1);
+  dd->crc = ~0;
+
+  // Calculate lenbits, lenbase, distbits, distbase
+  *dd->lenbase = 3;
+  for (i = 0; i<sizeof(dd->lenbits)-1; i++) {
+    if (i>4) {
+      if (!(i&3)) {
+        dd->lenbits[i]++;
+        n <<= 1;
+      }
+      if (i == 27) n--;
+      else dd->lenbits[i+1] = dd->lenbits[i];
+    }
+    dd->lenbase[i+1] = n + dd->lenbase[i];
+  }
+  n = 0;
+  for (i = 0; i<sizeof(dd->distbits); i++) {
+    dd->distbase[i] = 1<<n;
+    if (i) dd->distbase[i] += dd->distbase[i-1];
+    if (i>3 && !(i&1)) n++;
+    dd->distbits[i] = n;
+  }
+
+  // Init fixed huffman tables
+  if (!compress) {
+    char bits[288];
+
+    for (i=0; i<288; i++) bits[i] = 8 + (i>143) - ((i>255)<<1) + (i>279);
+    len2huff(dd->fixlithuff = dd->data+65536+512, bits, 288);
+    memset(bits, 5, 30);
+    len2huff(dd->fixdisthuff = ((struct huff *)dd->fixlithuff)+1, bits, 30);
+  }
+
+  return dd;
+}
+
+static void free_deflate(struct deflate *dd)
+{
+  free(dd->bb);
+  free(dd->crc_table);
+  free(dd->data);
+  free(dd);
+}
+
+static void gzip_crc(struct deflate *dd, char *data, int len)
+{
+  dd->crc = crc_update(dd->crc_table, 1, dd->crc, data, len);
+  dd->len += len;
+}
+
+// Start a gzip member, noting where it is in the file.
+static void gzip_header(struct deflate *dd)
+{
+  char hdr[10];
+
+  // Header from RFC 1952 section 2.2:
+  // 2 ID bytes (1F, 8b), gzip method byte (8=deflate), FLAG byte (none),
+  // 4 byte MTIME (zeroed), Extra Flags (2=maximum compression, 4=fastest),
+  // Operating System (FF=unknown)
+
+  dd->member = lseek(dd->bb->fd, 0, SEEK_CUR);
+  memcpy(hdr, "\x1f\x8b\x08\0\0\0\0\0\0\xff", 10);
+  hdr[8] = 2*(dd->level==9) + 4*(dd->level==1);
+  xwrite(dd->bb->fd, hdr, 10);
+}
+
+// Write the last block and trailer of a gzip member.
+static void gzip_trailer(struct deflate *dd)
+{
+  struct bitbuf *bb = dd->bb;
+
+  deflate_more(dd, 1);
+
+  // tail: crc32, len32
+
+  bitbuf_put(bb, 0, (8-bb->bitpos)&7);
+  bitbuf_put(bb, ~dd->crc, 32);
+  bitbuf_put(bb, dd->len, 32);
+  bitbuf_flush(bb);
+}
+
+// Start gzip compressing to fd at level 1-9.
+struct deflate *gzip_open(int fd, int level)
+{
+  struct deflate *dd = init_deflate(1);
+
+  dd->level = level;
+  dd->bb = bitbuf_init(fd, 65536);
+  gzip_header(dd);
+
+  return dd;
+}
+
+// Compress len bytes of buf, writing output as blocks fill up.
+void gzip_write(struct deflate *dd, char *buf, long len)
+{
+  unsigned i, n;
+
+  gzip_crc(dd, buf, len);
+  while (len) {
+    // Buffer full: write out what we have, then slide down a window.
+    if (dd->end == 65536) {
+      deflate_block(dd, dd->block, dd->pos-dd->waiting, 0);
+      memmove(dd->data, dd->data+32768, 32768);
+      dd->pos -= 32768;
+      dd->end -= 32768;
+      dd->block = dd->pos-dd->waiting;
+      for (i = 0; i<32768; i++) {
+        dd->hashhead[i] = dd->hashhead[i]>32768 ? dd->hashhead[i]-32768 : 0;
+        dd->hashchain[i] = dd->hashchain[i]>32768 ? dd->hashchain[i]-32768 : 0;
+      }
+    }
+    n = 65536-dd->end;
+    if (n > len) n = len;
+    memcpy(dd->data+dd->end, buf, n);
+    dd->end += n;
+    buf += n;
+    len -= n;
+    deflate_more(dd, 0);
+  }
+}
+
+// End this gzip member and start another, which can be decompressed without
+// anything before it. (Concatenated members decompress as one stream.)
+void gzip_restart(struct deflate *dd)
+{
+  gzip_trailer(dd);
+  dd->crc = ~0;
+  dd->len = dd->pos = dd->end = dd->block = dd->waiting = dd->prevlen = 0;
+  memset(dd->hashhead, 0, 32768*sizeof(*dd->hashhead));
+  gzip_header(dd);
+}
+
+// Finish the compressed stream and free dd.
+void gzip_close(struct deflate *dd)
+{
+  gzip_trailer(dd);
+  free_deflate(dd);
+}
+
+// Consume a gzip header, returning 0 if there isn't one.
+static int is_gzip(struct bitbuf *bb)
+{
+  int flags;
+
+  // Confirm signature
+  if (bitbuf_get(bb, 24) != 0x088b1f || (flags = bitbuf_get(bb, 8)) > 31)
+    return 0;
+  bitbuf_skip(bb, 6*8);
+
+  // Skip extra, name, comment, header CRC fields
+  if (flags & 4) bitbuf_skip(bb, 16);
+  if (flags & 8) while (bitbuf_get(bb, 8));
+  if (flags & 16) while (bitbuf_get(bb, 8));
+  if (flags & 2) bitbuf_skip(bb, 16);
+
+  return 1;
+}
+
+// Start decompressing gzip data from fd, after len bytes of it already read
+// into pre.
+struct deflate *gunzip_open(int fd, char *pre, int len)
+{
+  struct deflate *dd = init_deflate(0);
+  int max = len>65536 ? len : 65536;
+
+  dd->bb = bitbuf_init(fd, max);
+  if ((dd->bb->len = len)) memcpy(dd->bb->buf, pre, len);
+  dd->member = lseek(fd, 0, SEEK_CUR)-len;
+  if (!is_gzip(dd->bb)) error_exit("not gzip");
+
+  return dd;
+}
+
+// Read up to len bytes of decompressed data into buf, returning 0 at the end
+// of the gzip stream. A gzip header right after the end starts another one.
+long gunzip_read(struct deflate *dd, char *buf, long len)
+{
+  struct bitbuf *bb = dd->bb;
+
+  while (dd->wrote == dd->pos) {
+    if (dd->done == 2) return 0;
+    if (dd->done) {
+      // tail: crc32, len32
+      bitbuf_skip(bb, (8-bb->bitpos)&7);
+      if (~dd->crc != bitbuf_get(bb, 32)
+        || (unsigned)dd->len != bitbuf_get(bb, 32)) error_exit("bad crc");
+      dd->done = 2;
+      if (bitbuf_peek(bb, 16) != 0x8b1f) continue;
+      dd->member = lseek(bb->fd, 0, SEEK_CUR) - bb->len + (bb->bitpos>>3);
+      if (is_gzip(bb)) {
+        dd->crc = ~0;
+        dd->len = dd->pos = dd->wrote = dd->final = dd->done = 0;
+      }
+      continue;
+    }
+
+    // Once the buffer's been read, slide the last 32k (the window back
+    // references can reach into) down to the start.
+    if (dd->pos >= 65536) {
+      memmove(dd->data, dd->data+dd->pos-32768, 32768);
+      dd->pos = dd->wrote = 32768;
+    }
+    inflate_more(dd);
+  }
+  if (len > dd->pos-dd->wrote) len = dd->pos-dd->wrote;
+  memcpy(buf, dd->data+dd->wrote, len);
+  gzip_crc(dd, buf, len);
+  dd->wrote += len;
+
+  return len;
+}
+
+// Return where the current gzip member starts in the file, and set *len to
+// how much data has gone through it so far. When reading, a member that's
+// been read to the end counts as the next one.
+long long gzip_member(struct deflate *dd, long long *len)
+{
+  char c;
+
+  if (dd->done == 1 && dd->wrote == dd->pos) gunzip_read(dd, &c, 0);
+  *len = dd->len;
+
+  return dd->member;
+}
+
+void gunzip_close(struct deflate *dd)
+{
+  free_deflate(dd);
+}
+
+// Compress all of infd to outfd.
+void gzip_fd(int infd, int outfd, int level)
+{
+  struct deflate *dd = gzip_open(outfd, level);
+  long len;
+
+  while (0<(len = read(infd, libbuf, sizeof(libbuf))))
+    gzip_write(dd, libbuf, len);
+  if (len) perror_exit("read");
+  gzip_close(dd);
+}
+
+// Decompress gzip data from infd to outfd.
+void gunzip_fd(int infd, int outfd)
+{
+  struct deflate *dd = gunzip_open(infd, 0, 0);
+  long len;
+
+  while ((len = gunzip_read(dd, libbuf, sizeof(libbuf))))
+    xwrite(outfd, libbuf, len);
+  gunzip_close(dd);
+}
@@ -4,6 +4,7 @@
  */
 
 #include "toys.h"
+#include <sys/syscall.h>
 
 int isdotdot(char *name)
 {
@@ -29,6 +30,7 @@ struct dirtree *dirtree_add_node(struct dirtree *parent, char *name, int flags)
 {
   struct dirtree *dt = NULL;
   struct stat st;
+  char buf[4096]; // not libbuf, dirtree_parallel() calls this from threads
   int len = 0, linklen = 0;
 
   if (name) {
@@ -38,8 +40,8 @@ struct dirtree *dirtree_add_node(struct dirtree *parent, char *name, int flags)
     if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW*!(flags&DIRTREE_SYMFOLLOW)))
       goto error;
     if (S_ISLNK(st.st_mode)) {
-      if (0>(linklen = readlinkat(fd, name, libbuf, 4095))) goto error;
-      libbuf[linklen++]=0;
+      if (0>(linklen = readlinkat(fd, name, buf, 4095))) goto error;
+      buf[linklen++]=0;
     }
     len = strlen(name);
   }
@@ -49,7 +51,7 @@ struct dirtree *dirtree_add_node(struct dirtree *parent, char *name, int flags)
     memcpy(&(dt->st), &st, sizeof(struct stat));
     strcpy(dt->name, name);
 
-    if (linklen) dt->symlink = memcpy(len+(char *)dt, libbuf, linklen);
+    if (linklen) dt->symlink = memcpy(len+(char *)dt, buf, linklen);
   }
 
   return dt;
@@ -97,6 +99,85 @@ int dirtree_parentfd(struct dirtree *node)
   return node->parent ? node->parent->dirfd : AT_FDCWD;
 }
 
+// Fill in the rest of ->st for a DIRTREE_STATLESS node. (Call from the
+// callback, while the parent's dirfd is still open.) Returns 0 or -1 with
+// error already shown. The ->symlink of such a node stays NULL.
+
+int dirtree_stat(struct dirtree *node)
+{
+  char *path;
+
+  if (!node->nostat) return 0;
+  if (!fstatat(dirtree_parentfd(node), node->name, &node->st,
+      AT_SYMLINK_NOFOLLOW))
+  {
+    node->nostat = 0;
+
+    return 0;
+  }
+  perror_msg("%s", path = dirtree_path(node, 0));
+  free(path);
+
+  return -1;
+}
+
+// Read a directory with getdents64() into a big buffer instead of readdir(),
+// so we get d_type/d_ino for DIRTREE_STATLESS and fewer syscalls on huge dirs.
+
+struct dirtree_dirent {
+  unsigned long long ino;
+  long long off;
+  unsigned short reclen;
+  unsigned char type;
+  char name[];
+};
+
+struct dirtree_dents {
+  long long buf[4096];  // 32k, aligned for struct dirtree_dirent
+  int fd, len, pos;
+};
+
+static struct dirtree_dirent *dirtree_readdir(struct dirtree_dents *dd)
+{
+  struct dirtree_dirent *de;
+
+  if (dd->pos >= dd->len) {
+    dd->len = syscall(SYS_getdents64, dd->fd, dd->buf, sizeof(dd->buf));
+    if (dd->len < 1) return 0;
+    dd->pos = 0;
+  }
+  de = (void *)(dd->pos+(char *)dd->buf);
+  dd->pos += de->reclen;
+
+  return de;
+}
+
+// Create child node from directory entry. Without DIRTREE_STATLESS or when
+// d_type doesn't tell us enough (directories, symlinks we'd follow, or
+// filesystems that don't fill in d_type) this is just dirtree_add_node().
+
+static struct dirtree *dirtree_entry(struct dirtree *node,
+  struct dirtree_dirent *de, int flags)
+{
+  struct dirtree *new;
+  int type = de->type;
+
+  if ((flags&DIRTREE_PROC) && !isdigit(*de->name)) return 0;
+  if (!(flags&DIRTREE_STATLESS) || type==DT_UNKNOWN || type==DT_DIR
+      || (type==DT_LNK && (flags&DIRTREE_SYMFOLLOW)))
+    return dirtree_add_node(node, de->name, flags);
+
+  new = xzalloc(sizeof(struct dirtree)+strlen(de->name)+1);
+  new->parent = node;
+  strcpy(new->name, de->name);
+  new->st.st_mode = type<<12;  // DT_ values are the S_IFMT bits shifted down
+  new->st.st_ino = de->ino;
+  new->st.st_dev = node->st.st_dev;
+  new->nostat++;
+
+  return new;
+}
+
 // Handle callback for a node in the tree. Returns saved node(s) if
 // callback returns DIRTREE_SAVE, otherwise frees consumed nodes and
 // returns NULL. If !callback return top node unchanged.
@@ -131,28 +212,26 @@ int dirtree_recurse(struct dirtree *node,
           int (*callback)(struct dirtree *node), int dirfd, int flags)
 {
   struct dirtree *new, **ddt = &(node->child);
-  struct dirent *entry;
-  DIR *dir;
+  struct dirtree_dirent *entry;
+  struct dirtree_dents *dd;
 
   node->dirfd = dirfd;
-  if (node->dirfd == -1 || !(dir = fdopendir(node->dirfd))) {
+  if (node->dirfd == -1) {
     if (!(flags & DIRTREE_SHUTUP)) {
       char *path = dirtree_path(node, 0);
       perror_msg("No %s", path);
       free(path);
     }
-    close(node->dirfd);
 
     return flags;
   }
-
-  // according to the fddir() man page, the filehandle in the DIR * can still
-  // be externally used by things that don't lseek() it.
+  dd = xmalloc(sizeof(struct dirtree_dents));
+  dd->fd = node->dirfd;
+  dd->len = dd->pos = 0;
 
   // The extra parentheses are to shut the stupid compiler up.
-  while ((entry = readdir(dir))) {
-    if ((flags&DIRTREE_PROC) && !isdigit(*entry->d_name)) continue;
-    if (!(new = dirtree_add_node(node, entry->d_name, flags))) continue;
+  while ((entry = dirtree_readdir(dd))) {
+    if (!(new = dirtree_entry(node, entry, flags))) continue;
     new = dirtree_handle_callback(new, callback);
     if (new == DIRTREE_ABORTVAL) break;
     if (new) {
@@ -160,14 +239,19 @@ int dirtree_recurse(struct dirtree *node,
       ddt = &((*ddt)->next);
     }
   }
+  if (dd->len<0 && !(flags & DIRTREE_SHUTUP)) {
+    char *path = dirtree_path(node, 0);
+    perror_msg("No %s", path);
+    free(path);
+  }
+  free(dd);
 
   if (flags & DIRTREE_COMEAGAIN) {
     node->again++;
     flags = callback(node);
   }
 
-  // This closes filehandle as well, so note it
-  closedir(dir);
+  close(node->dirfd);
   node->dirfd = -1;
 
   return flags;
@@ -183,9 +267,194 @@ int dirtree_recurse(struct dirtree *node,
 struct dirtree *dirtree_flagread(char *path, int flags,
   int (*callback)(struct dirtree *node))
 {
+  if (flags&DIRTREE_PARALLEL)
+    return dirtree_parallel(path, flags, callback);
+
   return dirtree_handle_callback(dirtree_add_node(0, path, flags), callback);
 }
 
+// Directories dirtree_parallel() has started but not finished reading.
+struct dirtree_job {
+  struct dirtree_job *next, *up;
+  struct dirtree *node;
+  unsigned pending;  // 1 for reading this directory, +1 per unfinished subdir
+  int flags;
+};
+
+struct dirtree_pool {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  struct dirtree_job *jobs;
+  int (*callback)(struct dirtree *node);
+  unsigned threads, queued, busy;
+  int abort;
+};
+
+// Finish a directory once it and all its subdirectories are read: do the
+// COMEAGAIN callback and close it, then do the same for parent directories
+// this was the last thing holding open.
+static void dirtree_job_done(struct dirtree_pool *pool, struct dirtree_job *job)
+{
+  struct dirtree_job *up;
+  int flags;
+
+  for (;;) {
+    pthread_mutex_lock(&pool->lock);
+    flags = --job->pending;
+    pthread_mutex_unlock(&pool->lock);
+    if (flags) return;
+
+    if ((job->flags&DIRTREE_COMEAGAIN) && !pool->abort) {
+      job->node->again++;
+      flags = pool->callback(job->node);
+      if ((flags&DIRTREE_ABORT)==DIRTREE_ABORT) pool->abort++;
+    }
+    close(job->node->dirfd);
+    free(job->node);
+    up = job->up;
+    free(job);
+    if (!(job = up)) return;
+  }
+}
+
+// Read one directory, calling back for each entry. Subdirectories go on the
+// shared stack for idle threads if there's room, else we do them ourselves.
+static void dirtree_job_run(struct dirtree_pool *pool, struct dirtree_job *job)
+{
+  struct dirtree *node = job->node, *new;
+  struct dirtree_job *sub;
+  struct dirtree_dirent *entry;
+  struct dirtree_dents *dd = 0;
+  int flags;
+
+  // Keep the fd open for callbacks until the COMEAGAIN, but free the read
+  // buffer as soon as we're done reading.
+  node->dirfd = openat(dirtree_parentfd(node), node->name, O_CLOEXEC);
+  if (node->dirfd != -1 && !pool->abort) {
+    dd = xmalloc(sizeof(struct dirtree_dents));
+    dd->fd = node->dirfd;
+    dd->len = dd->pos = 0;
+  }
+
+  while (dd && !pool->abort && (entry = dirtree_readdir(dd))) {
+    if (!(new = dirtree_entry(node, entry, job->flags))) continue;
+    flags = pool->callback(new);
+    if ((flags&DIRTREE_ABORT)==DIRTREE_ABORT) pool->abort++;
+    if (!S_ISDIR(new->st.st_mode) || !(flags&(DIRTREE_RECURSE|DIRTREE_COMEAGAIN))
+        || pool->abort)
+    {
+      free(new);
+      continue;
+    }
+
+    sub = xzalloc(sizeof(struct dirtree_job));
+    sub->up = job;
+    sub->node = new;
+    sub->pending = 1;
+    sub->flags = flags;
+    pthread_mutex_lock(&pool->lock);
+    job->pending++;
+    if (pool->queued < 2*pool->threads) {
+      sub->next = pool->jobs;
+      pool->jobs = sub;
+      pool->queued++;
+      pthread_cond_signal(&pool->cond);
+      sub = 0;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    if (sub) dirtree_job_run(pool, sub);
+  }
+  if ((!dd || dd->len<0) && !pool->abort && !(job->flags & DIRTREE_SHUTUP)) {
+    char *path = dirtree_path(node, 0);
+
+    perror_msg("No %s", path);
+    free(path);
+  }
+  free(dd);
+
+  dirtree_job_done(pool, job);
+}
+
+static void *dirtree_thread(void *arg)
+{
+  struct dirtree_pool *pool = arg;
+  struct dirtree_job *job;
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (!(job = pool->jobs) && pool->busy)
+      pthread_cond_wait(&pool->cond, &pool->lock);
+    if (!job) break;
+    pool->jobs = job->next;
+    pool->queued--;
+    pool->busy++;
+    pthread_mutex_unlock(&pool->lock);
+
+    dirtree_job_run(pool, job);
+
+    pthread_mutex_lock(&pool->lock);
+    if (!--pool->busy && !pool->jobs) pthread_cond_broadcast(&pool->cond);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return 0;
+}
+
+// Like dirtree_flagread() but reading different directories in parallel
+// threads, for when stat() and readdir() latency dominate (network
+// filesystems, big trees on fast storage).
+//
+// The callback gets called from several threads at once, so it must be
+// threadsafe and can't care about order: entries of one directory still go
+// through one thread in readdir() order, but different directories don't.
+// COMEAGAIN still happens after everything under that directory is done.
+// The tree isn't saved (DIRTREE_SAVE is ignored, each node is freed after its
+// last callback), so this returns NULL, or DIRTREE_ABORTVAL if path didn't
+// exist or a callback returned DIRTREE_ABORT.
+
+struct dirtree *dirtree_parallel(char *path, int flags,
+  int (*callback)(struct dirtree *node))
+{
+  struct dirtree_pool pool;
+  struct dirtree *root = dirtree_add_node(0, path, flags);
+  pthread_t *threads;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int i;
+
+  if (!root) return DIRTREE_ABORTVAL;
+  flags = callback(root);
+  if (!S_ISDIR(root->st.st_mode) || !(flags&(DIRTREE_RECURSE|DIRTREE_COMEAGAIN))
+      || (flags&DIRTREE_ABORT)==DIRTREE_ABORT)
+  {
+    free(root);
+
+    return ((flags&DIRTREE_ABORT)==DIRTREE_ABORT) ? DIRTREE_ABORTVAL : 0;
+  }
+
+  // Threads mostly wait for I/O, so have a few per CPU.
+  memset(&pool, 0, sizeof(pool));
+  pthread_mutex_init(&pool.lock, 0);
+  pthread_cond_init(&pool.cond, 0);
+  pool.callback = callback;
+  pool.threads = 4*(cpus<1 ? 1 : cpus > 16 ? 16 : cpus);
+  pool.jobs = xzalloc(sizeof(struct dirtree_job));
+  pool.jobs->node = root;
+  pool.jobs->pending = 1;
+  pool.jobs->flags = flags;
+  pool.queued = 1;
+
+  threads = xmalloc(pool.threads*sizeof(pthread_t));
+  for (i = 1; i<pool.threads; i++)
+    if (pthread_create(threads+i, 0, dirtree_thread, &pool)) break;
+  dirtree_thread(&pool);
+  while (--i) pthread_join(threads[i], 0);
+  free(threads);
+  pthread_mutex_destroy(&pool.lock);
+  pthread_cond_destroy(&pool.cond);
+
+  return pool.abort ? DIRTREE_ABORTVAL : 0;
+}
+
 // Common case
 struct dirtree *dirtree_read(char *path, int (*callback)(struct dirtree *node))
 {
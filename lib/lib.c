@@ -678,6 +678,128 @@ char *get_line(int fd)
   return buf;
 }
 
+// Buffered line reader. Reads big blocks and hands out lines from its buffer,
+// so callers don't do a read() syscall per byte like get_rawline().
+
+struct linebuf *linebuf_new(int fd)
+{
+  struct linebuf *lb = xzalloc(sizeof(struct linebuf));
+
+  lb->fd = fd;
+  lb->size = 65536;
+  lb->buf = xmalloc(lb->size);
+
+  return lb;
+}
+
+static void linebuf_restore(struct linebuf *lb)
+{
+  if (lb->saved) lb->buf[lb->pos] = lb->save;
+  lb->saved = 0;
+}
+
+// Move unconsumed data to start of buffer (growing it if full) and read
+// more after it. Returns bytes read, 0 at EOF or error.
+long linebuf_fill(struct linebuf *lb)
+{
+  long i = lb->len-lb->pos;
+
+  linebuf_restore(lb);
+  if (lb->pos) memmove(lb->buf, lb->buf+lb->pos, i);
+  lb->len = i;
+  lb->pos = 0;
+  if (lb->len+1>=lb->size) lb->buf = xrealloc(lb->buf, lb->size *= 2);
+  if (1>(i = read(lb->fd, lb->buf+lb->len, lb->size-lb->len-1))) return 0;
+  lb->len += i;
+
+  return i;
+}
+
+// Return unconsumed data in buffer (without reading more)
+char *linebuf_peek(struct linebuf *lb, long *plen)
+{
+  linebuf_restore(lb);
+  *plen = lb->len-lb->pos;
+
+  return lb->buf+lb->pos;
+}
+
+// Discard len bytes of data returned by linebuf_peek()
+void linebuf_skip(struct linebuf *lb, long len)
+{
+  linebuf_restore(lb);
+  lb->pos += len;
+}
+
+// Return next line (including delimiter, if any) as a pointer into the
+// buffer, valid until the next call. The line is NUL terminated in place:
+// the byte after it is saved and restored next time. Returns NULL at EOF.
+char *linebuf_next(struct linebuf *lb, long *plen, char end)
+{
+  char *s;
+  long len, scan = 0;
+
+  linebuf_restore(lb);
+  for (;;) {
+    if ((s = memchr(lb->buf+lb->pos+scan, end, lb->len-lb->pos-scan))) {
+      len = s+1-(lb->buf+lb->pos);
+      break;
+    }
+    scan = lb->len-lb->pos;
+    if (!linebuf_fill(lb)) {
+      if (!(len = lb->len)) return 0;
+      break;
+    }
+  }
+  s = lb->buf+lb->pos;
+  lb->pos += len;
+  lb->save = s[len];
+  lb->saved = 1;
+  s[len] = 0;
+  if (plen) *plen = len;
+
+  return s;
+}
+
+// Like get_rawline(): malloced copy of line including delimiter.
+char *linebuf_rawline(struct linebuf *lb, long *plen, char end)
+{
+  long len;
+  char *s = linebuf_next(lb, &len, end);
+
+  if (plen) *plen = s ? len : 0;
+
+  return s ? xmemdup(s, len+1) : 0;
+}
+
+// Like get_line(): malloced copy of line with trailing newline removed.
+char *linebuf_line(struct linebuf *lb)
+{
+  long len;
+  char *s = linebuf_rawline(lb, &len, '\n');
+
+  if (s && s[--len]=='\n') s[len] = 0;
+
+  return s;
+}
+
+// Write buffered but unconsumed data to fd (discard it if fd is -1), leaving
+// the reader empty.
+void linebuf_flush(struct linebuf *lb, int fd)
+{
+  linebuf_restore(lb);
+  if (fd != -1 && lb->pos<lb->len)
+    xwrite(fd, lb->buf+lb->pos, lb->len-lb->pos);
+  lb->pos = lb->len = 0;
+}
+
+// Free reader (doesn't close its filehandle).
+void linebuf_free(struct linebuf *lb)
+{
+  if (lb) free(lb->buf);
+  free(lb);
+}
+
 int wfchmodat(int fd, char *name, mode_t mode)
 {
   int rc = fchmodat(fd, name, mode, 0);
@@ -767,6 +889,56 @@ void crc_init(unsigned int *crc_table, int little_endian)
   }
 }
 
+// Create 8 CRC32 lookup tables (8*256 entries) for crc_update(). The first
+// is the crc_init() table, and table k entry i is the crc of byte i followed
+// by k zero bytes, so 8 bytes of input take 8 lookups but no dependent shifts.
+
+void crc_init8(unsigned *crc_table, int little_endian)
+{
+  unsigned k, c;
+
+  crc_init(crc_table, little_endian);
+  for (k = 256; k<8*256; k++) {
+    c = crc_table[k-256];
+    crc_table[k] = little_endian ? (c>>8)^crc_table[c&255]
+      : (c<<8)^crc_table[c>>24];
+  }
+}
+
+// Update crc with len bytes of data, 8 at a time ("slicing by 8"), using
+// tables from crc_init8(). Doesn't pre or post invert.
+
+unsigned crc_update(unsigned *crc_table, int little_endian, unsigned crc,
+  void *data, size_t len)
+{
+  unsigned char *s = data;
+  unsigned *t = crc_table, a, b;
+
+  if (little_endian) {
+    for (; len && ((uintptr_t)s&3); len--) crc = t[(crc^*s++)&255]^(crc>>8);
+    for (; len>=8; len -= 8, s += 8) {
+      a = crc^SWAP_LE32(*(unsigned *)s);
+      b = SWAP_LE32(((unsigned *)s)[1]);
+      crc = t[7*256+(a&255)]^t[6*256+((a>>8)&255)]^t[5*256+((a>>16)&255)]
+        ^t[4*256+(a>>24)]^t[3*256+(b&255)]^t[2*256+((b>>8)&255)]
+        ^t[256+((b>>16)&255)]^t[b>>24];
+    }
+    while (len--) crc = t[(crc^*s++)&255]^(crc>>8);
+  } else {
+    for (; len && ((uintptr_t)s&3); len--) crc = (crc<<8)^t[(crc>>24)^*s++];
+    for (; len>=8; len -= 8, s += 8) {
+      a = crc^SWAP_BE32(*(unsigned *)s);
+      b = SWAP_BE32(((unsigned *)s)[1]);
+      crc = t[7*256+(a>>24)]^t[6*256+((a>>16)&255)]^t[5*256+((a>>8)&255)]
+        ^t[4*256+(a&255)]^t[3*256+(b>>24)]^t[2*256+((b>>16)&255)]
+        ^t[256+((b>>8)&255)]^t[b&255];
+    }
+    while (len--) crc = (crc<<8)^t[(crc>>24)^*s++];
+  }
+
+  return crc;
+}
+
 // Init base64 table
 
 void base64_init(char *p)
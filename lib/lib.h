@@ -40,6 +40,12 @@ struct num_cache {
   char data[];
 };
 
+struct dev_ino {
+  dev_t dev;
+  ino_t ino;
+  char *name;
+};
+
 void llist_free_arg(void *node);
 void llist_free_double(void *node);
 void llist_traverse(void *list, void (*using)(void *node));
@@ -51,6 +57,7 @@ void *dlist_terminate(void *list);
 struct num_cache *get_num_cache(struct num_cache *cache, long long num);
 struct num_cache *add_num_cache(struct num_cache **cache, long long num,
   void *data, int len);
+struct dev_ino *seen_inode(void **set, struct stat *st, char *name);
 
 // args.c
 void get_optflags(void);
@@ -75,8 +82,12 @@ void get_optflags(void);
 #define DIRTREE_BREADTH     32
 // skip non-numeric entries
 #define DIRTREE_PROC        64
+// dirtree_flagread() with threads, see dirtree_parallel() for the rules
+#define DIRTREE_PARALLEL   128
 // Don't look at any more files in this directory.
 #define DIRTREE_ABORT      256
+// Children only get st_mode/st_ino from getdents, see dirtree_stat()
+#define DIRTREE_STATLESS   512
 
 #define DIRTREE_ABORTVAL ((struct dirtree *)1)
 
@@ -86,7 +97,7 @@ struct dirtree {
   struct stat st;
   char *symlink;
   int dirfd;
-  char again;
+  char again, nostat;
   char name[];
 };
 
@@ -95,10 +106,15 @@ struct dirtree *dirtree_add_node(struct dirtree *p, char *name, int flags);
 char *dirtree_path(struct dirtree *node, int *plen);
 int dirtree_notdotdot(struct dirtree *catch);
 int dirtree_parentfd(struct dirtree *node);
+int dirtree_stat(struct dirtree *node);
+struct dirtree *dirtree_handle_callback(struct dirtree *new,
+  int (*callback)(struct dirtree *node));
 int dirtree_recurse(struct dirtree *node, int (*callback)(struct dirtree *node),
   int dirfd, int symfollow);
 struct dirtree *dirtree_flagread(char *path, int flags,
   int (*callback)(struct dirtree *node));
+struct dirtree *dirtree_parallel(char *path, int flags,
+  int (*callback)(struct dirtree *node));
 struct dirtree *dirtree_read(char *path, int (*callback)(struct dirtree *node));
 
 // help.c
@@ -217,12 +233,18 @@ void loopfiles_rw(char **argv, int flags, int permissions,
   void (*function)(int fd, char *name));
 void loopfiles(char **argv, void (*function)(int fd, char *name));
 void loopfiles_lines(char **argv, void (*function)(char **pline, long len));
+long long sendfile_len(int in, int out, long long bytes);
+long long xsendfile_len(int in, int out, long long bytes);
 long long xsendfile(int in, int out);
+long long xcopyfile(int in, int out);
 int wfchmodat(int rc, char *name, mode_t mode);
 int copy_tempfile(int fdin, char *name, char **tempname);
 void delete_tempfile(int fdin, int fdout, char **tempname);
 void replace_tempfile(int fdin, int fdout, char **tempname);
 void crc_init(unsigned int *crc_table, int little_endian);
+void crc_init8(unsigned *crc_table, int little_endian);
+unsigned crc_update(unsigned *crc_table, int little_endian, unsigned crc,
+  void *data, size_t len);
 void base64_init(char *p);
 int yesno(int def);
 int qstrcmp(const void *a, const void *b);
@@ -244,6 +266,23 @@ char *getgroupname(gid_t gid);
 void do_lines(int fd, void (*call)(char **pline, long len));
 long environ_bytes();
 
+struct linebuf {
+  char *buf;
+  long pos, len, size;
+  int fd;
+  char save, saved;
+};
+
+struct linebuf *linebuf_new(int fd);
+long linebuf_fill(struct linebuf *lb);
+char *linebuf_peek(struct linebuf *lb, long *plen);
+void linebuf_skip(struct linebuf *lb, long len);
+char *linebuf_next(struct linebuf *lb, long *plen, char end);
+char *linebuf_rawline(struct linebuf *lb, long *plen, char end);
+char *linebuf_line(struct linebuf *lb);
+void linebuf_flush(struct linebuf *lb, int fd);
+void linebuf_free(struct linebuf *lb);
+
 #define HR_SPACE 1 // Space between number and units
 #define HR_B     2 // Use "B" for single byte units
 #define HR_1000  4 // Use decimal instead of binary units
@@ -294,6 +333,29 @@ int xconnect(struct addrinfo *ai_arg);
 int xpoll(struct pollfd *fds, int nfds, int timeout);
 int pollinate(int in1, int in2, int out1, int out2, int timeout, int shutdown_timeout);
 
+// deflate.c
+struct deflate *gzip_open(int fd, int level);
+void gzip_write(struct deflate *dd, char *buf, long len);
+void gzip_restart(struct deflate *dd);
+long long gzip_member(struct deflate *dd, long long *len);
+void gzip_close(struct deflate *dd);
+struct deflate *gunzip_open(int fd, char *pre, int len);
+long gunzip_read(struct deflate *dd, char *buf, long len);
+void gunzip_close(struct deflate *dd);
+void gzip_fd(int infd, int outfd, int level);
+void gunzip_fd(int infd, int outfd);
+
+// bunzip.c
+char *bunzipStream(int src_fd, int dst_fd);
+struct bunzip_data *bunzip_open(int fd, char *pre, int len);
+long bunzip_read(struct bunzip_data *bd, char *buf, long len);
+void bunzip_close(struct bunzip_data *bd);
+
+// xz.c
+struct unxz *unxz_open(int fd, char *pre, int len);
+long unxz_read(struct unxz *xz, char *buf, long len);
+void unxz_close(struct unxz *xz);
+
 // password.c
 int get_salt(char *salt, char * algo);
 
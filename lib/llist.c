@@ -128,3 +128,76 @@ struct num_cache *add_num_cache(struct num_cache **cache, long long num,
 
   return 0;
 }
+
+// Open addressing hash table of struct dev_ino. (ino 0 marks an empty slot.)
+struct dev_ino_set {
+  unsigned long count, mask;
+  struct dev_ino *table;
+};
+
+static unsigned long dev_ino_hash(dev_t dev, ino_t ino)
+{
+  unsigned long long hash = (ino^((unsigned long long)dev<<40^dev))
+    *0x9e3779b97f4a7c15ULL;
+
+  return hash^(hash>>29);
+}
+
+// Hardlink detection: return the entry for a file we've already seen with
+// this dev+ino, or add it (with a copy of name, if any) and return NULL.
+// Only multiply linked non-directories get added. NULL st frees the set.
+struct dev_ino *seen_inode(void **set, struct stat *st, char *name)
+{
+  struct dev_ino_set *ds = *set;
+  struct dev_ino *di, *old;
+  unsigned long i, j;
+
+  if (!st) {
+    if (ds) {
+      for (i = 0; i<=ds->mask; i++) free(ds->table[i].name);
+      free(ds->table);
+      free(ds);
+      *set = 0;
+    }
+
+    return 0;
+  }
+
+  // Skipping dir nodes isn't _quite_ right. They're not hardlinked, but could
+  // be bind mounted. Still, it's more efficient and the archivers can't use
+  // hardlinked directory info anyway. (Note that we don't catch bind mounted
+  // _files_ because it doesn't change st_nlink.)
+  if (S_ISDIR(st->st_mode) || st->st_nlink<2 || !st->st_ino) return 0;
+
+  if (!ds) {
+    *set = ds = xzalloc(sizeof(struct dev_ino_set));
+    ds->mask = 255;
+    ds->table = xzalloc((ds->mask+1)*sizeof(struct dev_ino));
+  }
+
+  // Double the table when it's 3/4 full, so probe sequences stay short.
+  if (4*(ds->count+1) > 3*(ds->mask+1)) {
+    old = ds->table;
+    ds->table = xzalloc(2*(ds->mask+1)*sizeof(struct dev_ino));
+    ds->mask = 2*ds->mask+1;
+    for (i = 0; i<=ds->mask/2; i++) {
+      if (!old[i].ino) continue;
+      for (j = dev_ino_hash(old[i].dev, old[i].ino);; j++)
+        if (!ds->table[j&ds->mask].ino) break;
+      ds->table[j&ds->mask] = old[i];
+    }
+    free(old);
+  }
+
+  for (i = dev_ino_hash(st->st_dev, st->st_ino);; i++) {
+    di = ds->table+(i&ds->mask);
+    if (!di->ino) break;
+    if (di->ino == st->st_ino && di->dev == st->st_dev) return di;
+  }
+  di->dev = st->st_dev;
+  di->ino = st->st_ino;
+  if (name) di->name = xstrdup(name);
+  ds->count++;
+
+  return 0;
+}
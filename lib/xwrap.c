@@ -8,6 +8,8 @@
  */
 
 #include "toys.h"
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
 
 // strcpy and strncat with size checking. Size is the total space in "dest",
 // including null terminator. Exit if there's not enough space for the string
@@ -737,22 +739,157 @@ void xpidfile(char *name)
   close(fd);
 }
 
-// Copy the rest of in to out and close both files.
-
-long long xsendfile(int in, int out)
+// Copy up to bytes (-1 for all) of in to out, splicing in the kernel when
+// either side is a pipe, else through a buffer that grows from 64k to 1M
+// while reads keep filling it. Returns bytes copied, or -1 with errno if read
+// failed. Dies if write fails.
+long long sendfile_len(int in, int out, long long bytes)
 {
-  long long total = 0;
-  long len;
+  long long total = 0, len = 0;
+  struct stat st;
+  int size = 65536, pipes = 0;
+  char *buf = 0;
 
   if (in<0) return 0;
-  for (;;) {
-    len = xread(in, libbuf, sizeof(libbuf));
-    if (len<1) break;
-    xwrite(out, libbuf, len);
+  if (!fstat(in, &st) && S_ISFIFO(st.st_mode)) pipes++;
+  else posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+  if (!fstat(out, &st) && S_ISFIFO(st.st_mode)) pipes++;
+
+  while (bytes<0 || total<bytes) {
+    len = (bytes<0 || bytes-total>(1<<20)) ? 1<<20 : bytes-total;
+#ifdef SYS_splice
+    if (pipes) {
+      if (0<=(len = syscall(SYS_splice, in, 0, out, 0, len, 0))) {
+        if (!len) break;
+        total += len;
+
+        continue;
+      }
+      // Not all files can splice (O_APPEND, ttys...), and splice errors
+      // don't say which side failed, so let read() and xwrite() sort it out.
+      pipes = 0;
+      len = (bytes<0 || bytes-total>size) ? size : bytes-total;
+    }
+#endif
+    if (len>size) len = size;
+    if (!buf) buf = xmalloc(size);
+    if (1>(len = read(in, buf, len))) {
+      if (len<0 && errno==EINTR) continue;
+      break;
+    }
+    xwrite(out, buf, len);
     total += len;
+    if (len==size && size<(1<<20)) {
+      free(buf);
+      buf = xmalloc(size *= 2);
+    }
   }
+  free(buf);
+
+  return len<0 ? -1 : total;
+}
+
+// Copy exactly bytes (or the rest if -1) of in to out, dying if we can't.
+long long xsendfile_len(int in, int out, long long bytes)
+{
+  long long len = sendfile_len(in, out, bytes);
+
+  if (len<0) perror_exit("sendfile");
+  if (bytes>=0 && len!=bytes) error_exit("short read %lld/%lld", len, bytes);
+
+  return len;
+}
+
+// Copy the rest of in to out.
+long long xsendfile(int in, int out)
+{
+  return xsendfile_len(in, out, -1);
+}
+
+// Copy len bytes at *off in in to *off+delta in out without going through
+// userspace, advancing *off. *how says which way worked last time:
+// 0 copy_file_range(), 1 sendfile(), 2 neither. Returns bytes copied, 0 at
+// EOF, or -1 when in-kernel copying isn't possible so caller should read().
+static long long copy_range(int in, int out, long long *off, long long len,
+  long long delta, int *how)
+{
+  long long pos = *off+delta;
+  off_t soff = *off;
+  long rc = -1;
+
+  if (len > 1<<30) len = 1<<30;
+#ifdef SYS_copy_file_range
+  if (!*how) {
+    rc = syscall(SYS_copy_file_range, in, off, out, &pos, len, 0);
+    if (rc>=0) return rc;
+    if (errno!=EXDEV && errno!=EINVAL && errno!=ENOSYS && errno!=EOPNOTSUPP
+      && errno!=EBADF) perror_exit("copy_file_range");
+  }
+#endif
+  if (*how<2) {
+    *how = 1;
+    if (pos == lseek(out, pos, SEEK_SET)) rc = sendfile(out, in, &soff, len);
+    if (rc>=0) {
+      *off = soff;
+
+      return rc;
+    }
+    if (errno!=EINVAL && errno!=ENOSYS && errno!=ESPIPE) perror_exit("sendfile");
+  }
+  *how = 2;
+
+  return -1;
+}
+
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+// Copy the rest of regular file in to empty file out: try to share the
+// blocks (reflink on btrfs/xfs), then copy data in the kernel skipping holes,
+// falling back to xsendfile() for whatever's left. Returns bytes copied.
+
+long long xcopyfile(int in, int out)
+{
+  struct stat st;
+  long long start = lseek(in, 0, SEEK_CUR), off = start, delta, data, hole;
+  int how = 0;
+
+  if (start<0 || fstat(in, &st) || !S_ISREG(st.st_mode) || st.st_size<=start
+    || 0>(delta = lseek(out, 0, SEEK_CUR)-start)) return xsendfile(in, out);
+
+  // Whole file clone, when the filesystem can share blocks between files
+  if (!start && !delta && !ioctl(out, FICLONE, in)) {
+    lseek(in, st.st_size, SEEK_SET);
+    lseek(out, st.st_size, SEEK_SET);
+
+    return st.st_size;
+  }
+
+  // Only look for holes when there are fewer blocks than the size needs
+  while (off<st.st_size) {
+    data = off;
+    hole = st.st_size;
+    if ((long long)st.st_blocks*512 < st.st_size) {
+      if (0>(data = lseek(in, off, SEEK_DATA))) data = errno==ENXIO ? hole : off;
+      else if (0>(hole = lseek(in, data, SEEK_HOLE))) hole = st.st_size;
+    }
+
+    // Trailing hole: extend to length
+    if (data>=st.st_size) {
+      if (ftruncate(out, st.st_size+delta)) perror_exit("ftruncate");
+      off = st.st_size;
+    } else for (off = data; off<hole;)
+      if (1>copy_range(in, out, &off, hole-off, delta, &how)) break;
+    if (off<hole) break;
+  }
+
+  // Get any stragglers (file grew, or we couldn't copy in-kernel) the old
+  // fashioned way.
+  xlseek(in, off, SEEK_SET);
+  lseek(out, off+delta, SEEK_SET);
 
-  return total;
+  return off-start+xsendfile(in, out);
 }
 
 double xstrtod(char *s)
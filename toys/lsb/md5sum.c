@@ -1,9 +1,10 @@
-/* md5sum.c - Calculate RFC 1321 md5 hash and sha1 hash.
+/* md5sum.c - Calculate RFC 1321 md5 hash and sha1/sha2 hashes.
  *
  * Copyright 2012 Rob Landley <rob@landley.net>
  *
  * See http://refspecs.linuxfoundation.org/LSB_4.1.0/LSB-Core-generic/LSB-Core-generic/md5sum.html
  * and http://www.ietf.org/rfc/rfc1321.txt
+ * and https://nvlpubs.nist.gov/nistpubs/FIPS/NIST.FIPS.180-4.pdf
  *
  * They're combined this way to share infrastructure, and because md5sum is
  * and LSB standard command (but sha1sum and newer hashes are a good idea,
@@ -13,8 +14,8 @@
  * versions of these functions, but provide a built-in version to reduce
  * required dependencies.
 
-USE_MD5SUM(NEWTOY(md5sum, "bc*[!bc]", TOYFLAG_USR|TOYFLAG_BIN))
-USE_SHA1SUM(NEWTOY(sha1sum, "bc*[!bc]", TOYFLAG_USR|TOYFLAG_BIN))
+USE_MD5SUM(NEWTOY(md5sum, "j#<1bc*[!bc]", TOYFLAG_USR|TOYFLAG_BIN))
+USE_SHA1SUM(NEWTOY(sha1sum, "j#<1bc*[!bc]", TOYFLAG_USR|TOYFLAG_BIN))
 USE_SHA224SUM(OLDTOY(sha224sum, sha1sum, TOYFLAG_USR|TOYFLAG_BIN))
 USE_SHA256SUM(OLDTOY(sha256sum, sha1sum, TOYFLAG_USR|TOYFLAG_BIN))
 USE_SHA384SUM(OLDTOY(sha384sum, sha1sum, TOYFLAG_USR|TOYFLAG_BIN))
@@ -24,19 +25,20 @@ config MD5SUM
   bool "md5sum"
   default y
   help
-    usage: md5sum [-b] [-c FILE] [FILE]...
+    usage: md5sum [-b] [-j N] [-c FILE] [FILE]...
 
     Calculate md5 hash for each input file, reading from stdin if none.
     Output one hash (32 hex digits) for each input file, followed by filename.
 
     -b	brief (hash only, no filename)
     -c	Check each line of FILE is the same hash+filename we'd output
+    -j	Hash N files at once (output stays in order)
 
 config SHA1SUM
   bool "sha1sum"
   default y
   help
-    usage: sha?sum [-b] [-c FILE] [FILE]...
+    usage: sha?sum [-b] [-j N] [-c FILE] [FILE]...
 
     calculate sha hash for each input file, reading from stdin if none. Output
     one hash (40 hex digits for sha1, 56 for sha224, 64 for sha256, 96 for sha384,
@@ -44,32 +46,29 @@ config SHA1SUM
 
     -b	brief (hash only, no filename)
     -c	Check each line of FILE is the same hash+filename we'd output
+    -j	Hash N files at once (output stays in order)
 
 config SHA224SUM
   bool "sha224sum"
   default y
-  depends on TOYBOX_LIBCRYPTO
   help
     See sha1sum
 
 config SHA256SUM
   bool "sha256sum"
   default y
-  depends on TOYBOX_LIBCRYPTO
   help
     See sha1sum
 
 config SHA384SUM
   bool "sha384sum"
   default y
-  depends on TOYBOX_LIBCRYPTO
   help
     See sha1sum
 
 config SHA512SUM
   bool "sha512sum"
   default y
-  depends on TOYBOX_LIBCRYPTO
   help
     See sha1sum
 */
@@ -87,20 +86,40 @@ typedef int SHA512_CTX;
 
 GLOBALS(
   struct arg_list *c;
+  long j;
 
   int sawline;
 
-  // Crypto variables blanked after summing
-  unsigned state[5];
-  unsigned oldstate[5];
-  uint64_t count;
-  union {
-    char c[64];
-    unsigned i[16];
-  } buffer;
+  // -j worker pool
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t *threads;
+  struct md5_job *jobs, **jobtail, *pending;
+  int threadcount, queued, stop;
 )
 
+// A file waiting for (or done with) a -j worker
+struct md5_job {
+  struct md5_job *next;
+  char *name, *line;
+  int err, done;
+  char hash[129];
+};
+
+// Built-in hash state. sha384 and sha512 use 64 bit words and 128 byte
+// frames, the rest 32 bit words and 64 byte frames.
+struct hash_ctx {
+  union {
+    unsigned i[8];
+    uint64_t l[8];
+  } state;
+  uint64_t count;
+  char buffer[128];
+};
+
 #define rol(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
+#define ror(value, bits) (((value) >> (bits)) | ((value) << (32 - (bits))))
+#define ror64(value, bits) (((value) >> (bits)) | ((value) << (64 - (bits))))
 
 // for(i=0; i<64; i++) md5table[i] = abs(sin(i+1))*(1<<32);  But calculating
 // that involves not just floating point but pulling in -lm (and arguing with
@@ -129,12 +148,14 @@ static const uint8_t md5rot[64] = {
 
 // Mix next 64 bytes of data into md5 hash
 
-static void md5_transform(void)
+static void md5_transform(struct hash_ctx *ctx, char *data)
 {
-  unsigned x[4], *b = TT.buffer.i;
+  unsigned x[4], b[16];
   int i;
 
-  memcpy(x, TT.state, sizeof(x));
+  memcpy(b, data, sizeof(b));
+  if (IS_BIG_ENDIAN) for (i=0; i<16; i++) b[i] = SWAP_LE32(b[i]);
+  memcpy(x, ctx->state.i, sizeof(x));
 
   for (i=0; i<64; i++) {
     unsigned int in, temp, swap;
@@ -160,23 +181,24 @@ static void md5_transform(void)
     x[1] += rol(temp, md5rot[i]);
     x[0] = swap;
   }
-  for (i=0; i<4; i++) TT.state[i] += x[i];
+  for (i=0; i<4; i++) ctx->state.i[i] += x[i];
 }
 
 // Mix next 64 bytes of data into sha1 hash.
 
 static const unsigned rconsts[]={0x5A827999,0x6ED9EBA1,0x8F1BBCDC,0xCA62C1D6};
 
-static void sha1_transform(void)
+static void sha1_transform(struct hash_ctx *ctx, char *data)
 {
   int i, j, k, count;
-  unsigned *block = TT.buffer.i;
-  unsigned *rot[5], *temp;
+  unsigned block[16], oldstate[5], *rot[5], *temp;
+
+  memcpy(block, data, sizeof(block));
 
   // Copy context->state[] to working vars
   for (i=0; i<5; i++) {
-    TT.oldstate[i] = TT.state[i];
-    rot[i] = TT.state + i;
+    oldstate[i] = ctx->state.i[i];
+    rot[i] = ctx->state.i + i;
   }
   // 4 rounds of 20 operations each.
   for (i=count=0; i<4; i++) {
@@ -190,9 +212,7 @@ static void sha1_transform(void)
         else work ^= *rot[1];
       }
 
-      if (!i && j<16)
-        work += block[count] = (rol(block[count],24)&0xFF00FF00)
-                             | (rol(block[count],8)&0x00FF00FF);
+      if (!i && j<16) work += block[count] = SWAP_BE32(block[count]);
       else
         work += block[count&15] = rol(block[(count+13)&15]
               ^ block[(count+8)&15] ^ block[(count+2)&15] ^ block[count&15], 1);
@@ -207,33 +227,153 @@ static void sha1_transform(void)
     }
   }
   // Add the previous values of state[]
-  for (i=0; i<5; i++) TT.state[i] += TT.oldstate[i];
+  for (i=0; i<5; i++) ctx->state.i[i] += oldstate[i];
 }
 
-// Fill the 64-byte working buffer and call transform() when full.
+// Fractional parts of the cube roots of the first 80 primes. sha256 uses
+// the top 32 bits of the first 64.
+
+static const uint64_t sha512table[80] = {
+  0x428a2f98d728ae22, 0x7137449123ef65cd, 0xb5c0fbcfec4d3b2f,
+  0xe9b5dba58189dbbc, 0x3956c25bf348b538, 0x59f111f1b605d019,
+  0x923f82a4af194f9b, 0xab1c5ed5da6d8118, 0xd807aa98a3030242,
+  0x12835b0145706fbe, 0x243185be4ee4b28c, 0x550c7dc3d5ffb4e2,
+  0x72be5d74f27b896f, 0x80deb1fe3b1696b1, 0x9bdc06a725c71235,
+  0xc19bf174cf692694, 0xe49b69c19ef14ad2, 0xefbe4786384f25e3,
+  0x0fc19dc68b8cd5b5, 0x240ca1cc77ac9c65, 0x2de92c6f592b0275,
+  0x4a7484aa6ea6e483, 0x5cb0a9dcbd41fbd4, 0x76f988da831153b5,
+  0x983e5152ee66dfab, 0xa831c66d2db43210, 0xb00327c898fb213f,
+  0xbf597fc7beef0ee4, 0xc6e00bf33da88fc2, 0xd5a79147930aa725,
+  0x06ca6351e003826f, 0x142929670a0e6e70, 0x27b70a8546d22ffc,
+  0x2e1b21385c26c926, 0x4d2c6dfc5ac42aed, 0x53380d139d95b3df,
+  0x650a73548baf63de, 0x766a0abb3c77b2a8, 0x81c2c92e47edaee6,
+  0x92722c851482353b, 0xa2bfe8a14cf10364, 0xa81a664bbc423001,
+  0xc24b8b70d0f89791, 0xc76c51a30654be30, 0xd192e819d6ef5218,
+  0xd69906245565a910, 0xf40e35855771202a, 0x106aa07032bbd1b8,
+  0x19a4c116b8d2d0c8, 0x1e376c085141ab53, 0x2748774cdf8eeb99,
+  0x34b0bcb5e19b48a8, 0x391c0cb3c5c95a63, 0x4ed8aa4ae3418acb,
+  0x5b9cca4f7763e373, 0x682e6ff3d6b2b8a3, 0x748f82ee5defb2fc,
+  0x78a5636f43172f60, 0x84c87814a1f0ab72, 0x8cc702081a6439ec,
+  0x90befffa23631e28, 0xa4506cebde82bde9, 0xbef9a3f7b2c67915,
+  0xc67178f2e372532b, 0xca273eceea26619c, 0xd186b8c721c0c207,
+  0xeada7dd6cde0eb1e, 0xf57d4f7fee6ed178, 0x06f067aa72176fba,
+  0x0a637dc5a2c898a6, 0x113f9804bef90dae, 0x1b710b35131c471b,
+  0x28db77f523047d84, 0x32caab7b40c72493, 0x3c9ebe0a15c9bebc,
+  0x431d67c49c100d4c, 0x4cc5d4becb3e42b6, 0x597f299cfc657e2a,
+  0x5fcb6fab3ad6faec, 0x6c44198c4a475817
+};
+
+// Fractional parts of the square roots of the first 8 primes (sha512), and
+// of the next 8 (sha384). sha256 and sha224 use the top and bottom halves.
+
+static const uint64_t sha512init[8] = {
+  0x6a09e667f3bcc908, 0xbb67ae8584caa73b, 0x3c6ef372fe94f82b,
+  0xa54ff53a5f1d36f1, 0x510e527fade682d1, 0x9b05688c2b3e6c1f,
+  0x1f83d9abfb41bd6b, 0x5be0cd19137e2179
+}, sha384init[8] = {
+  0xcbbb9d5dc1059ed8, 0x629a292a367cd507, 0x9159015a3070dd17,
+  0x152fecd8f70e5939, 0x67332667ffc00b31, 0x8eb44a8768581511,
+  0xdb0c2e0d64f98fa7, 0x47b5481dbefa4fa4
+};
+
+// Mix next 64 bytes of data into sha256 hash.
 
-static void hash_update(char *data, unsigned int len, void (*transform)(void))
+static void sha256_transform(struct hash_ctx *ctx, char *data)
 {
-  unsigned int i, j;
+  unsigned w[64], a, b, c, d, e, f, g, h, t1, t2;
+  int i;
 
-  j = TT.count & 63;
-  TT.count += len;
+  memcpy(w, data, 64);
+  for (i=0; i<64; i++) {
+    if (i<16) w[i] = SWAP_BE32(w[i]);
+    else w[i] = w[i-16] + w[i-7]
+      + (ror(w[i-15], 7) ^ ror(w[i-15], 18) ^ (w[i-15]>>3))
+      + (ror(w[i-2], 17) ^ ror(w[i-2], 19) ^ (w[i-2]>>10));
+  }
 
-  for (;;) {
-    // Grab next chunk of data, return if it's not enough to process a frame
-    i = 64 - j;
+  a = ctx->state.i[0]; b = ctx->state.i[1];
+  c = ctx->state.i[2]; d = ctx->state.i[3];
+  e = ctx->state.i[4]; f = ctx->state.i[5];
+  g = ctx->state.i[6]; h = ctx->state.i[7];
+  for (i=0; i<64; i++) {
+    t1 = h + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + ((e&f) ^ (~e&g))
+      + (sha512table[i]>>32) + w[i];
+    t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a&b) ^ (a&c) ^ (b&c));
+    h = g; g = f; f = e; e = d+t1;
+    d = c; c = b; b = a; a = t1+t2;
+  }
+  ctx->state.i[0] += a; ctx->state.i[1] += b;
+  ctx->state.i[2] += c; ctx->state.i[3] += d;
+  ctx->state.i[4] += e; ctx->state.i[5] += f;
+  ctx->state.i[6] += g; ctx->state.i[7] += h;
+}
+
+// Mix next 128 bytes of data into sha512 hash.
+
+static void sha512_transform(struct hash_ctx *ctx, char *data)
+{
+  uint64_t w[80], a, b, c, d, e, f, g, h, t1, t2;
+  int i;
+
+  memcpy(w, data, 128);
+  for (i=0; i<80; i++) {
+    if (i<16) w[i] = SWAP_BE64(w[i]);
+    else w[i] = w[i-16] + w[i-7]
+      + (ror64(w[i-15], 1) ^ ror64(w[i-15], 8) ^ (w[i-15]>>7))
+      + (ror64(w[i-2], 19) ^ ror64(w[i-2], 61) ^ (w[i-2]>>6));
+  }
+
+  a = ctx->state.l[0]; b = ctx->state.l[1];
+  c = ctx->state.l[2]; d = ctx->state.l[3];
+  e = ctx->state.l[4]; f = ctx->state.l[5];
+  g = ctx->state.l[6]; h = ctx->state.l[7];
+  for (i=0; i<80; i++) {
+    t1 = h + (ror64(e, 14) ^ ror64(e, 18) ^ ror64(e, 41)) + ((e&f) ^ (~e&g))
+      + sha512table[i] + w[i];
+    t2 = (ror64(a, 28) ^ ror64(a, 34) ^ ror64(a, 39)) + ((a&b) ^ (a&c) ^ (b&c));
+    h = g; g = f; f = e; e = d+t1;
+    d = c; c = b; b = a; a = t1+t2;
+  }
+  ctx->state.l[0] += a; ctx->state.l[1] += b;
+  ctx->state.l[2] += c; ctx->state.l[3] += d;
+  ctx->state.l[4] += e; ctx->state.l[5] += f;
+  ctx->state.l[6] += g; ctx->state.l[7] += h;
+}
+
+// Built-in hashes, in the same order as the sha224sum...sha512sum names.
+// Frame size in bytes, digest size in bytes.
+static struct builtin_hash {
+  char *name;
+  void (*transform)(struct hash_ctx *ctx, char *data);
+  unsigned char frame, digest;
+} builtins[] = {
+  {"md5sum", md5_transform, 64, 16}, {"sha1sum", sha1_transform, 64, 20},
+  {"sha224sum", sha256_transform, 64, 28},
+  {"sha256sum", sha256_transform, 64, 32},
+  {"sha384sum", sha512_transform, 128, 48},
+  {"sha512sum", sha512_transform, 128, 64}
+};
+
+// Process whole frames straight out of data, saving any leftover partial
+// frame in ctx->buffer until the next call completes it.
+
+static void hash_update(struct hash_ctx *ctx, struct builtin_hash *hash,
+  char *data, unsigned long len)
+{
+  unsigned frame = hash->frame, i, j = ctx->count & (frame-1);
+
+  ctx->count += len;
+  if (j) {
+    i = frame - j;
     if (i>len) i = len;
-    memcpy(TT.buffer.c+j, data, i);
-    if (j+i != 64) break;
-
-    // Process a frame
-    if (IS_BIG_ENDIAN)
-      for (j=0; j<16; j++) TT.buffer.i[j] = SWAP_LE32(TT.buffer.i[j]);
-    transform();
-    j=0;
+    memcpy(ctx->buffer+j, data, i);
+    if (j+i != frame) return;
+    hash->transform(ctx, ctx->buffer);
     data += i;
     len -= i;
   }
+  for (; len >= frame; len -= frame, data += frame) hash->transform(ctx, data);
+  memcpy(ctx->buffer, data, len);
 }
 
 // Initialize array tersely
@@ -243,7 +383,7 @@ static void hash_update(char *data, unsigned int len, void (*transform)(void))
 #define SHA1_DIGEST_LENGTH SHA_DIGEST_LENGTH
 
 // Call the assembly optimized library code when CFG_TOYBOX_LIBCRYPTO
-static void do_lib_hash(int fd, char *name)
+static void do_lib_hash(int fd, char *buf, char *out)
 {
   // Largest context
   SHA512_CTX ctx;
@@ -263,6 +403,7 @@ static void do_lib_hash(int fd, char *name)
       USE_SHA512SUM(HASH_INIT("sha512sum", SHA512),)
     )
   }, * hash;
+  unsigned char digest[64];
   int i;
 
   // This should never NOT match, so no need to check
@@ -272,81 +413,197 @@ static void do_lib_hash(int fd, char *name)
 
   hash->init(&ctx);
   for (;;) {
-      i = read(fd, toybuf, sizeof(toybuf));
+      i = read(fd, buf, sizeof(toybuf));
       if (i<1) break;
-      hash->update(&ctx, toybuf, i);
+      hash->update(&ctx, buf, i);
   }
-  hash->final(toybuf+128, &ctx);
+  hash->final(digest, &ctx);
 
-  for (i = 0; i<hash->digest_length; i++)
-    sprintf(toybuf+2*i, "%02x", toybuf[i+128]);
+  for (i = 0; i<hash->digest_length; i++) sprintf(out+2*i, "%02x", digest[i]);
 }
 
-// Callback for loopfiles()
+// Hash fd using buf (sizeof(toybuf)) to read, writing hex digest to out
 
-static void do_builtin_hash(int fd, char *name)
+static void do_builtin_hash(int fd, char *buf, char *out)
 {
+  struct hash_ctx ctx;
+  struct builtin_hash *hash;
   uint64_t count;
-  int i, sha1=toys.which->name[0]=='s';
-  char buf;
-  void (*transform)(void);
-
-  /* SHA1 initialization constants  (md5sum uses first 4) */
-  TT.state[0] = 0x67452301;
-  TT.state[1] = 0xEFCDAB89;
-  TT.state[2] = 0x98BADCFE;
-  TT.state[3] = 0x10325476;
-  TT.state[4] = 0xC3D2E1F0;
-  TT.count = 0;
-
-  transform = sha1 ? sha1_transform : md5_transform;
+  int i, frame;
+
+  // This should never NOT match, so no need to check
+  for (i = 0; i<ARRAY_LEN(builtins)-1; i++)
+    if (!strcmp(toys.which->name, builtins[i].name)) break;
+  hash = builtins+i;
+  frame = hash->frame;
+
+  // sha256 and sha224 use half of the sha512 and sha384 values, md5sum uses
+  // the first 4 of sha1's
+  if (i>3) memcpy(ctx.state.l, i==4 ? sha384init : sha512init, 64);
+  else if (i>1) for (i = 0; i<8; i++)
+    ctx.state.i[i] = hash->digest==32 ? sha512init[i]>>32 : sha384init[i];
+  else memcpy(ctx.state.i, (unsigned []){0x67452301, 0xEFCDAB89, 0x98BADCFE,
+    0x10325476, 0xC3D2E1F0}, 20);
+  ctx.count = 0;
+
   for (;;) {
-    i = read(fd, toybuf, sizeof(toybuf));
+    i = read(fd, buf, sizeof(toybuf));
     if (i<1) break;
-    hash_update(toybuf, i, transform);
+    hash_update(&ctx, hash, buf, i);
   }
 
-  count = TT.count << 3;
+  count = ctx.count << 3;
 
   // End the message by appending a "1" bit to the data, ending with the
-  // message size (in bits, big endian), and adding enough zero bits in
-  // between to pad to the end of the next 64-byte frame.
+  // message size (in bits, big endian except md5), and adding enough zero
+  // bits in between to pad to the end of the next frame. (The size field is
+  // 16 bytes for 128 byte frames, but we only fill in the bottom 8.)
   //
   // Since our input up to now has been in whole bytes, we can deal with
   // bytes here too.
 
-  buf = 0x80;
-  do {
-    hash_update(&buf, 1, transform);
-    buf = 0;
-  } while ((TT.count & 63) != 56);
-  count = sha1 ? SWAP_BE64(count) : SWAP_LE64(count);
-  hash_update((void *)&count, 8, transform);
-
-  if (sha1)
-    for (i = 0; i < 20; i++)
-      sprintf(toybuf+2*i, "%02x", 255&(TT.state[i>>2] >> ((3-(i & 3)) * 8)));
-  else for (i=0; i<4; i++) sprintf(toybuf+8*i, "%08x", bswap_32(TT.state[i]));
+  memset(buf, 0, 2*frame);
+  buf[0] = 0x80;
+  i = frame - ((ctx.count+1+frame/8) & (frame-1));
+  if (i == frame) i = 0;
+  i += 1+frame/8;
+  count = (hash->transform == md5_transform) ? SWAP_LE64(count)
+    : SWAP_BE64(count);
+  memcpy(buf+i-8, &count, 8);
+  hash_update(&ctx, hash, buf, i);
+
+  for (i = 0; i<hash->digest; i++) {
+    if (frame == 128) count = ctx.state.l[i>>3] >> (56-8*(i&7));
+    else if (hash->transform == md5_transform)
+      count = ctx.state.i[i>>2] >> (8*(i&3));
+    else count = ctx.state.i[i>>2] >> (24-8*(i&3));
+    sprintf(out+2*i, "%02x", (int)(count&255));
+  }
 
   // Wipe variables. Cryptographer paranoia.
-  memset(TT.state, 0, sizeof(TT)-((long)TT.state-(long)&TT));
-  i = strlen(toybuf)+1;
-  memset(toybuf+i, 0, sizeof(toybuf)-i);
+  memset(&ctx, 0, sizeof(ctx));
+  memset(buf, 0, sizeof(toybuf));
+}
+
+// Hash fd into out (hex string), reading through buf (sizeof(toybuf) bytes).
+static void hash_fd(int fd, char *buf, char *out)
+{
+  if (CFG_TOYBOX_LIBCRYPTO) do_lib_hash(fd, buf, out);
+  else do_builtin_hash(fd, buf, out);
+}
+
+// Show one result: the hash and name, or for -c whether line matched it.
+static void show_hash(char *hash, char *name, char *line, int err)
+{
+  int fail = 0;
+
+  if (err) {
+    errno = err;
+    perror_msg_raw(name);
+  }
+  if (!line) {
+    if (!err)
+      printf((toys.optflags & FLAG_b) ? "%s\n" : "%s  %s\n", hash, name);
+  } else {
+    if (err || strcasecmp(line, hash)) toys.exitval = fail = 1;
+    printf("%s: %s\n", name, fail ? "FAILED" : "OK");
+  }
 }
 
-// Call builtin or lib hash function, then display output if necessary
-static void do_hash(int fd, char *name)
+// Worker thread for -j: open and hash queued files.
+static void *md5_thread(void *arg)
 {
-  if (CFG_TOYBOX_LIBCRYPTO) do_lib_hash(fd, name);
-  else do_builtin_hash(fd,name);
+  struct md5_job *job;
+  char *buf = xmalloc(sizeof(toybuf));
+  int fd;
+
+  for (;;) {
+    pthread_mutex_lock(&TT.lock);
+    while (!(job = TT.pending) && !TT.stop) pthread_cond_wait(&TT.cond, &TT.lock);
+    if (job) TT.pending = job->next;
+    pthread_mutex_unlock(&TT.lock);
+    if (!job) break;
+
+    fd = !strcmp(job->name, "-") ? 0 : open(job->name, O_RDONLY);
+    if (fd == -1) job->err = errno;
+    else {
+      hash_fd(fd, buf, job->hash);
+      if (fd) close(fd);
+    }
 
-  if (name)
-    printf((toys.optflags & FLAG_b) ? "%s\n" : "%s  %s\n", toybuf, name);
+    pthread_mutex_lock(&TT.lock);
+    job->done = 1;
+    pthread_cond_broadcast(&TT.cond);
+    pthread_mutex_unlock(&TT.lock);
+  }
+  free(buf);
+
+  return 0;
+}
+
+// Show finished jobs from the head of the queue, waiting for unfinished
+// ones while more than "left" are outstanding. Called with TT.lock held.
+static void md5_emit(int left)
+{
+  struct md5_job *job;
+
+  while ((job = TT.jobs)) {
+    if (!job->done) {
+      if (TT.queued <= left) break;
+      pthread_cond_wait(&TT.cond, &TT.lock);
+      continue;
+    }
+    if (!(TT.jobs = job->next)) TT.jobtail = &TT.jobs;
+    TT.queued--;
+
+    pthread_mutex_unlock(&TT.lock);
+    show_hash(job->hash, job->name, job->line, job->err);
+    free(job->line);
+    free(job);
+    pthread_mutex_lock(&TT.lock);
+  }
+}
+
+// Hash name (checking it against line for -c) now, or queue it for the -j
+// workers. Returns 1 if the job took ownership of line.
+static int do_name(char *name, char *line)
+{
+  struct md5_job *job;
+  int fd;
+
+  if (!TT.threadcount) {
+    char hash[129];
+
+    fd = !strcmp(name, "-") ? 0 : open(name, O_RDONLY);
+    if (fd != -1) {
+      hash_fd(fd, toybuf, hash);
+      if (fd) close(fd);
+    }
+    show_hash(hash, name, line, fd == -1 ? errno : 0);
+
+    return 0;
+  }
+
+  job = xzalloc(sizeof(struct md5_job));
+  job->name = name;
+  job->line = line;
+  pthread_mutex_lock(&TT.lock);
+  *TT.jobtail = job;
+  TT.jobtail = &job->next;
+  if (!TT.pending) TT.pending = job;
+  TT.queued++;
+  pthread_cond_broadcast(&TT.cond);
+
+  // Bound pending output to a few files per worker.
+  md5_emit(4*TT.threadcount);
+  pthread_mutex_unlock(&TT.lock);
+
+  return 1;
 }
 
 static int do_c(char *line, size_t len)
 {
-  int space = 0, fail = 0;
+  int space = 0;
   char *name;
 
   for (name = line; *name; name++) {
@@ -358,16 +615,9 @@ static int do_c(char *line, size_t len)
 
   if (!space || !*line || !*name) error_msg("bad line %s", line);
   else {
-    int fd = !strcmp(name, "-") ? 0 : open(name, O_RDONLY);
-
     TT.sawline = 1;
-    if (fd==-1) {
-      perror_msg_raw(name);
-      *toybuf = 0;
-    } else do_hash(fd, 0);
-    if (strcasecmp(line, toybuf)) toys.exitval = fail = 1;
-    printf("%s: %s\n", name, fail ? "FAILED" : "OK");
-    if (fd>0) close(fd);
+
+    return do_name(name, line);
   }
 
   return 0;
@@ -409,13 +659,36 @@ int looplines(char *name, int trim, int (*do_line)(char *line, size_t len))
 void md5sum_main(void)
 {
   struct arg_list *al;
+  char **ss;
+
+  // Start -j workers. If none start, just hash on this thread.
+  if (TT.j > 1) {
+    pthread_mutex_init(&TT.lock, 0);
+    pthread_cond_init(&TT.cond, 0);
+    TT.threads = xmalloc(TT.j*sizeof(pthread_t));
+    TT.jobtail = &TT.jobs;
+    for (; TT.threadcount < TT.j; TT.threadcount++)
+      if (pthread_create(TT.threads+TT.threadcount, 0, md5_thread, 0)) break;
+  }
 
-  if (!TT.c) loopfiles(toys.optargs, do_hash);
-  else for (al = TT.c; al; al = al->next) {
+  if (!TT.c) {
+    for (ss = *toys.optargs ? toys.optargs : (char *[]){"-", 0}; *ss; ss++)
+      do_name(*ss, 0);
+  } else for (al = TT.c; al; al = al->next) {
     TT.sawline = 0;
     looplines(al->arg, 1, do_c);
     if (!TT.sawline) error_msg("%s: no lines", al->arg);
   }
+
+  if (TT.threadcount) {
+    pthread_mutex_lock(&TT.lock);
+    md5_emit(0);
+    TT.stop = 1;
+    pthread_cond_broadcast(&TT.cond);
+    pthread_mutex_unlock(&TT.lock);
+    while (TT.threadcount) pthread_join(TT.threads[--TT.threadcount], 0);
+    if (CFG_TOYBOX_FREE) free(TT.threads);
+  }
 }
 
 void sha1sum_main(void)
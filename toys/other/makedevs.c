@@ -43,6 +43,7 @@ void makedevs_main()
 {
   int fd = 0, line_no, i;
   char *line = NULL;
+  struct linebuf *lb;
 
   // Open file and chdir, verbosely
   xprintf("rootdir = %s\n", *toys.optargs);
@@ -52,7 +53,8 @@ void makedevs_main()
   } else xprintf("table = <stdin>\n");
   xchdir(*toys.optargs);
 
-  for (line_no = 0; (line = get_line(fd)); free(line)) {
+  lb = linebuf_new(fd);
+  for (line_no = 0; (line = linebuf_line(lb)); free(line)) {
     char type=0, user[64], group[64], *node, *ptr = line;
     unsigned int mode = 0755, major = 0, minor = 0, cnt = 0, incr = 0, 
                  st_val = 0;
@@ -108,5 +110,6 @@ void makedevs_main()
         perror_msg("line %d: can't chown/chmod '%s'", line_no, ptr);
     }
   }
+  linebuf_free(lb);
   xclose(fd);
 }
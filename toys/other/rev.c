@@ -17,12 +17,14 @@ config REV
 
 static void do_rev(int fd, char *name)
 {
+  struct linebuf *lb = linebuf_new(fd);
   char *c;
 
   for (;;) {
-    unsigned len, i;
+    long len, i;
 
-    if (!(c = get_line(fd))) break;
+    if (!(c = linebuf_next(lb, &len, '\n'))) break;
+    if (len && c[len-1]=='\n') c[len-1] = 0;
     len = strlen(c);
     if (len--) for (i = 0; i <= len/2; i++) {
       char tmp = c[i];
@@ -31,8 +33,8 @@ static void do_rev(int fd, char *name)
       c[len-i] = tmp;
     }
     xputs(c);
-    free(c);
   }
+  linebuf_free(lb);
 }
 
 void rev_main(void)
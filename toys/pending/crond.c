@@ -373,6 +373,7 @@ static void scan_cronfiles()
   while ((entry = readdir(dp))) {
     int fd;
     char *line;
+    struct linebuf *lb;
     CRONFILE *cfile;
 
     if (entry->d_name[0] == '.' && (!entry->d_name[1] ||
@@ -389,8 +390,10 @@ static void scan_cronfiles()
     cfile = xzalloc(sizeof(CRONFILE));
     cfile->username = xstrdup(entry->d_name);
 
-    for (; (line = get_line(fd)); free(line))
+    lb = linebuf_new(fd);
+    for (; (line = linebuf_line(lb)); free(line))
       parse_line(line, cfile);
+    linebuf_free(lb);
 
     // If there is no job for a cron, remove the VAR list.
     if (!cfile->job) {
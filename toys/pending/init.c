@@ -134,7 +134,9 @@ static void inittab_parsing(void)
     add_new_action(SYSINIT, "/etc/init.d/rcS", "");
     add_new_action(RESPAWN, "/sbin/getty -n -l /bin/sh -L 115200 tty1 vt100", "");
   } else {
-    while((q = p = get_line(fd))) { //read single line from /etc/inittab
+    struct linebuf *lb = linebuf_new(fd);
+
+    while((q = p = linebuf_line(lb))) { //read single line from /etc/inittab
       char *x;
 
       if ((x = strchr(p, '#'))) *x = '\0';
@@ -184,6 +186,7 @@ static void inittab_parsing(void)
       free(command);
     } //while line
 
+    linebuf_free(lb);
     close(fd);
   }
 }
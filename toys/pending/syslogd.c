@@ -35,6 +35,18 @@ config SYSLOGD
 #define FOR_syslogd
 #define SYSLOG_NAMES
 #include "toys.h"
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+// Datagrams to receive per recvmmsg(), and lines to batch up per log file
+#define RECV_BATCH 16
+#define LOG_BATCH 64
+
+// glibc only prototypes recvmmsg() and struct mmsghdr for _GNU_SOURCE
+struct syslog_mmsg {
+  struct msghdr hdr;
+  unsigned len;
+};
 
 // UNIX Sockets for listening
 struct unsocks {
@@ -50,8 +62,10 @@ struct logfile {
   char *filename;
   uint32_t facility[8];
   uint8_t level[LOG_NFACILITIES];
-  int logfd;
+  int logfd, isreg, iovcnt;
+  off_t size;
   struct sockaddr_in saddr;
+  struct iovec iov[LOG_BATCH];
 };
 
 GLOBALS(
@@ -68,6 +82,11 @@ GLOBALS(
   struct unsocks *lsocks;  // list of listen sockets
   struct logfile *lfiles;  // list of write logfiles
   int sigfd[2];
+
+  struct utsname uts;
+  char *hostname, *inbuf, *outbuf, timestamp[16];
+  unsigned outlen;
+  time_t lasttime;
 )
 
 // Lookup numerical code from name
@@ -233,6 +252,15 @@ static int parse_config_file(void)
   return 0;
 }
 
+// Note whether a log file is a regular file, and how big it is so far.
+static void logfile_size(struct logfile *tf)
+{
+  struct stat st;
+
+  tf->isreg = !fstat(tf->logfd, &st) && S_ISREG(st.st_mode);
+  tf->size = tf->isreg ? st.st_size : 0;
+}
+
 // open every log file in list.
 static void open_logfiles(void)
 {
@@ -272,19 +300,34 @@ static void open_logfiles(void)
       tfd->filename = "/dev/console";
       tfd->logfd = open(tfd->filename, O_APPEND);
     }
+    logfile_size(tfd);
   }
 }
 
-//write to file with rotation
-static int write_rotate(struct logfile *tf, int len)
+// Write out a log file's batched lines
+static void flush_logfile(struct logfile *tf)
+{
+  if (!tf->iovcnt) return;
+  if (writev(tf->logfd, tf->iov, tf->iovcnt) < 0)
+    perror_msg("write failed file : %s ", tf->filename);
+  tf->iovcnt = 0;
+}
+
+// Flush every log file, freeing the formatted line buffer for reuse
+static void flush_logfiles(void)
 {
-  int size, isreg;
-  struct stat statf;
-  isreg = (!fstat(tf->logfd, &statf) && S_ISREG(statf.st_mode));
-  size = statf.st_size;
+  struct logfile *tf;
 
+  for (tf = TT.lfiles; tf; tf = tf->next) flush_logfile(tf);
+  TT.outlen = 0;
+}
+
+//queue line for file with rotation. Only regular files batch writes.
+static void write_rotate(struct logfile *tf, char *line, int len)
+{
   if ((toys.optflags & FLAG_s) || (toys.optflags & FLAG_b)) {
-    if (TT.rot_size && isreg && (size + len) > (TT.rot_size*1024)) {
+    if (TT.rot_size && tf->isreg && (tf->size + len) > (TT.rot_size*1024)) {
+      flush_logfile(tf);
       if (TT.rot_count) { /* always 0..99 */
         int i = strlen(tf->filename) + 3 + 1;
         char old_file[i];
@@ -302,21 +345,24 @@ static int write_rotate(struct logfile *tf, int len)
         tf->logfd = open(tf->filename, O_CREAT | O_WRONLY | O_APPEND, 0666);
         if (tf->logfd < 0) {
           perror_msg("can't open %s", tf->filename);
-          return -1;
+          return;
         }
       }
       ftruncate(tf->logfd, 0);
+      tf->size = 0;
     }
   }
-  return write(tf->logfd, toybuf, len);
+  tf->size += len;
+  tf->iov[tf->iovcnt].iov_base = line;
+  tf->iov[tf->iovcnt++].iov_len = len;
+  if (!tf->isreg || tf->iovcnt == LOG_BATCH) flush_logfile(tf);
 }
 
 //Parse messege and write to file.
 static void logmsg(char *msg, int len)
 {
   time_t now;
-  char *p, *ts, *lvlstr, *facstr;
-  struct utsname uts;
+  char *p, *ts, *lvlstr, *facstr, *line;
   int pri = 0;
   struct logfile *tf = TT.lfiles;
 
@@ -332,8 +378,13 @@ static void logmsg(char *msg, int len)
    */
   if (len < 16 || msg[3] != ' ' || msg[6] != ' ' || msg[9] != ':'
       || msg[12] != ':' || msg[15] != ' ') {
+    // ctime() is slow enough to matter, so reformat only once per second.
     time(&now);
-    ts = ctime(&now) + 4; /* skip day of week */
+    if (now != TT.lasttime) {
+      memcpy(TT.timestamp, ctime(&now) + 4, 15); /* skip day of week */
+      TT.lasttime = now;
+    }
+    ts = TT.timestamp;
   } else {
     now = 0;
     ts = msg;
@@ -343,28 +394,31 @@ static void logmsg(char *msg, int len)
   fac = LOG_FAC(pri);
   lvl = LOG_PRI(pri);
 
-  if (toys.optflags & FLAG_K) len = sprintf(toybuf, "<%d> %s\n", pri, msg);
+  // Format into the shared line buffer, which log files point into until
+  // flushed. A line is at most ~1100 bytes (1023 byte message plus header).
+  if (TT.outlen > 65536-2048) flush_logfiles();
+  line = TT.outbuf + TT.outlen;
+  if (toys.optflags & FLAG_K) len = sprintf(line, "<%d> %s\n", pri, msg);
   else {
     char facbuf[12], pribuf[12];
 
     facstr = dec(pri & LOG_FACMASK, facilitynames, facbuf);
     lvlstr = dec(LOG_PRI(pri), prioritynames, pribuf);
 
-    p = "local";
-    if (!uname(&uts)) p = uts.nodename;
-    if (toys.optflags & FLAG_S) len = sprintf(toybuf, "%s %s\n", ts, msg);
-    else len = sprintf(toybuf, "%s %s %s.%s %s\n", ts, p, facstr, lvlstr, msg);
+    if (toys.optflags & FLAG_S) len = sprintf(line, "%s %s\n", ts, msg);
+    else len = sprintf(line, "%s %s %s.%s %s\n", ts, TT.hostname, facstr,
+      lvlstr, msg);
   }
   if (lvl >= TT.log_prio) return;
+  TT.outlen += len;
 
   for (; tf; tf = tf->next) {
     if (tf->logfd > 0) {
       if (!((tf->facility[lvl] & (1 << fac)) || (tf->level[fac] & (1<<lvl)))) {
-        int wlen, isNetwork = *tf->filename == '@';
-        if (isNetwork)
-          wlen = sendto(tf->logfd, omsg, olen, 0, (struct sockaddr*)&tf->saddr, sizeof(tf->saddr));
-        else wlen = write_rotate(tf, len);
-        if (wlen < 0) perror_msg("write failed file : %s ", tf->filename + isNetwork);
+        if (*tf->filename != '@') write_rotate(tf, line, len);
+        else if (0 > sendto(tf->logfd, omsg, olen, 0,
+            (struct sockaddr*)&tf->saddr, sizeof(tf->saddr)))
+          perror_msg("write failed file : %s ", tf->filename + 1);
       }
     }
   }
@@ -397,6 +451,38 @@ static void cleanup(void)
   }
 }
 
+// Receive up to RECV_BATCH waiting datagrams from sd into TT.inbuf (1k each,
+// NUL terminated), storing their lengths in len[]. Returns how many.
+static int recv_batch(int sd, int *len)
+{
+  int n = -1;
+#ifdef SYS_recvmmsg
+  struct syslog_mmsg msgs[RECV_BATCH];
+  struct iovec iov[RECV_BATCH];
+  int i;
+
+  memset(msgs, 0, sizeof(msgs));
+  for (i = 0; i < RECV_BATCH; i++) {
+    iov[i].iov_base = TT.inbuf + 1024*i;
+    iov[i].iov_len = 1023;
+    msgs[i].hdr.msg_iov = iov+i;
+    msgs[i].hdr.msg_iovlen = 1;
+  }
+  n = syscall(SYS_recvmmsg, sd, msgs, RECV_BATCH, MSG_DONTWAIT, 0);
+  for (i = 0; i < n; i++) TT.inbuf[1024*i + (len[i] = msgs[i].len)] = 0;
+#else
+  errno = ENOSYS;
+#endif
+  if (n < 0 && errno == ENOSYS) {
+    if ((*len = recv(sd, TT.inbuf, 1023, MSG_DONTWAIT)) < 0) return 0;
+    TT.inbuf[*len] = 0;
+
+    return 1;
+  }
+
+  return n < 0 ? 0 : n;
+}
+
 static void signal_handler(int sig)
 {
   unsigned char ch = sig;
@@ -406,17 +492,20 @@ static void signal_handler(int sig)
 void syslogd_main(void)
 {
   struct unsocks *tsd;
-  int nfds, retval, last_len=0;
+  int nfds, retval, last_len=0, i, n, rounds, lens[RECV_BATCH];
   struct timeval tv;
   fd_set rfds;        // fds for reading
-  char *temp, *buffer = (toybuf +2048), *last_buf = (toybuf + 3072); //these two buffs are of 1K each
+  char *temp, *buffer, *last_buf = toybuf; //last message, for -D
 
   if ((toys.optflags & FLAG_p) && (strlen(TT.unix_socket) > 108))
     error_exit("Socket path should not be more than 108");
 
   TT.config_file = (toys.optflags & FLAG_f) ?
                    TT.config_file : "/etc/syslog.conf"; //DEFCONFFILE
+  TT.inbuf = xmalloc(RECV_BATCH*1024);
+  TT.outbuf = xmalloc(65536);
 init_jumpin:
+  TT.hostname = uname(&TT.uts) ? "local" : TT.uts.nodename;
   tsd = xzalloc(sizeof(struct unsocks));
 
   tsd->path = (toys.optflags & FLAG_p) ? TT.unix_socket : "/dev/log"; // DEFLOGSOCK
@@ -482,6 +571,9 @@ init_jumpin:
 
   logmsg("<46>Toybox: syslogd started", 27); //27 : the length of message
   for (;;) {
+    // Write out everything received since the last wait
+    flush_logfiles();
+
     // Add opened socks to rfds for select()
     FD_ZERO(&rfds);
     for (tsd = TT.lsocks; tsd; tsd = tsd->next) FD_SET(tsd->sd, &rfds);
@@ -506,6 +598,7 @@ init_jumpin:
         case SIGINT:     /* FALLTHROUGH */
         case SIGQUIT:
           logmsg("<46>syslogd exiting", 19);
+          flush_logfiles();
           if (CFG_TOYBOX_FREE ) cleanup();
           signal(sig, SIG_DFL);
           sigset_t ss;
@@ -517,30 +610,34 @@ init_jumpin:
           break;
         case SIGHUP:
           logmsg("<46>syslogd exiting", 19);
+          flush_logfiles();
           cleanup(); //cleanup is done, as we restart syslog.
           goto init_jumpin;
         default: break;
       }
     } else { /* Some activity on listen sockets. */
+      // Drain each ready socket a batch at a time, so a burst is formatted
+      // and written out together. Cap it so signals still get noticed.
       for (tsd = TT.lsocks; tsd; tsd = tsd->next) {
-        int sd = tsd->sd;
-        if (FD_ISSET(sd, &rfds)) {
-          int len = read(sd, buffer, 1023); //buffer is of 1K, hence readingonly 1023 bytes, 1 for NUL
-          if (len > 0) {
-            buffer[len] = '\0';
-            if((toys.optflags & FLAG_D) && (len == last_len))
-              if (!memcmp(last_buf, buffer, len)) break;
-
-            memcpy(last_buf, buffer, len);
-            last_len = len;
-            logmsg(buffer, len);
+        if (!FD_ISSET(tsd->sd, &rfds)) continue;
+        for (rounds = 0; rounds < 64; rounds++) {
+          n = recv_batch(tsd->sd, lens);
+          for (i = 0; i < n; i++) {
+            buffer = TT.inbuf + 1024*i;
+            if (lens[i] < 1) continue;
+            if ((toys.optflags & FLAG_D) && (lens[i] == last_len))
+              if (!memcmp(last_buf, buffer, lens[i])) continue;
+
+            memcpy(last_buf, buffer, last_len = lens[i]);
+            logmsg(buffer, lens[i]);
           }
-          break;
+          if (n < RECV_BATCH) break;
         }
       }
     }
   }
 clean_and_exit:
   logmsg("<46>syslogd exiting", 19);
+  flush_logfiles();
   if (CFG_TOYBOX_FREE ) cleanup();
 }
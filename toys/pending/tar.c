@@ -7,13 +7,13 @@
  * For writing to external program
  * http://www.gnu.org/software/tar/manual/html_node/Writing-to-an-External-Program.html
 
-USE_TAR(NEWTOY(tar, "&(no-recursion)(numeric-owner)(no-same-permissions)(overwrite)(exclude)*(to-command):o(no-same-owner)p(same-permissions)k(keep-old)c(create)|h(dereference)x(extract)|t(list)|v(verbose)j(bzip2)z(gzip)O(to-stdout)m(touch)X(exclude-from)*T(files-from)*C(directory):f(file):[!txc][!jz]", TOYFLAG_USR|TOYFLAG_BIN))
+USE_TAR(NEWTOY(tar, "&(index):(no-recursion)(numeric-owner)(no-same-permissions)(overwrite)(exclude)*(to-command):o(no-same-owner)p(same-permissions)k(keep-old)c(create)|h(dereference)x(extract)|t(list)|v(verbose)j(bzip2)z(gzip)J(xz)O(to-stdout)m(touch)X(exclude-from)*T(files-from)*C(directory):f(file):[!txc][!jzJ]", TOYFLAG_USR|TOYFLAG_BIN))
 
 config TAR
   bool "tar"
   default n
   help
-    usage: tar -[cxtjzhmvO] [-X FILE] [-T FILE] [-f TARFILE] [-C DIR]
+    usage: tar -[cxtjzJhmvO] [-X FILE] [-T FILE] [-f TARFILE] [-C DIR]
 
     Create, extract, or list files from a tar file
 
@@ -27,10 +27,14 @@ config TAR
     v Verbose
     x Extract
     z (De)compress using gzip
+    J (De)compress using xz
     C Change to DIR before operation
     O Extract to stdout
     exclude=FILE File to exclude
     X File with names to exclude
+    index=FILE Member offsets, to seek straight to members named on command
+               line (written by -c, or by -t/-x if FILE missing or older)
+               Works on uncompressed and gzip archives
     T File with names to include
 */
 
@@ -44,11 +48,30 @@ GLOBALS(
   struct arg_list *exc_file;
   char *tocmd;
   struct arg_list *exc;
+  char *index;
 
   struct arg_list *inc, *pass;
   void *inodes, *handle;
+  struct tar_id *uids, *gids;
+  struct tar_pool *pool;
+  char *lastdir, *idxtmp;
+  int nowriters, idxfd;
+  pid_t cpid;
+  struct tar_index *idx;
+  long idxlen, idxpos;
 )
 
+struct tar_index {
+  long long off, skip;
+  char *name;
+};
+
+struct tar_id {
+  struct tar_id *next;
+  unsigned id;
+  char found, name[];
+};
+
 struct tar_hdr {
   char name[100], mode[8], uid[8], gid[8],size[12], mtime[12], chksum[8],
        type, link[100], magic[8], uname[32], gname[32], major[8], minor[8],
@@ -65,30 +88,55 @@ struct file_header {
   dev_t device;
 };
 
+// codec is the in-process (de)compressor for -z, -j or -J, if any.
 struct archive_handler {
   int src_fd;
   struct file_header file_hdr;
   off_t offset;
   void (*extract_handler)(struct archive_handler*);
+  void *codec;
 };
 
-struct inode_list {
-  struct inode_list *next;
-  char *arg;
-  ino_t ino;
-  dev_t dev;
-};
+// Read from the archive, through the decompressor if any.
+static int tar_read(struct archive_handler *tar, char *buf, int len)
+{
+  int i, n;
+
+  if (!tar->codec) return readall(tar->src_fd, buf, len);
+  for (i = 0; i<len; i += n) {
+    if (toys.optflags & FLAG_z) n = gunzip_read(tar->codec, buf+i, len-i);
+    else if (toys.optflags & FLAG_j) n = bunzip_read(tar->codec, buf+i, len-i);
+    else n = unxz_read(tar->codec, buf+i, len-i);
+    if (!n) break;
+  }
+
+  return i;
+}
 
-static void copy_in_out(int src, int dst, off_t size)
+// Write to the archive, through the compressor if any.
+static void tar_write(struct archive_handler *tar, char *buf, int len)
 {
-  int i, rd, rem = size%512, cnt;
-  
-  cnt = size/512 + (rem?1:0);
+  if (tar->codec) gzip_write(tar->codec, buf, len);
+  else writeall(tar->src_fd, buf, len);
+}
+
+// Copy size bytes of archive data to dst, or skip them if there's nowhere to
+// put them (dst -1, couldn't create file).
+static void copy_in_out(struct archive_handler *tar, int dst, off_t size)
+{
+  int len;
 
-  for (i = 0; i < cnt; i++) {
-    rd = (i == cnt-1 && rem) ? rem : 512;
-    xreadall(src, toybuf, rd);
-    writeall(dst, toybuf, rd);
+  if (!tar->codec) {
+    if (dst<0) {
+      if (lskip(tar->src_fd, size)) error_exit("short read");
+    } else xsendfile_len(tar->src_fd, dst, size);
+
+    return;
+  }
+  for (; size; size -= len) {
+    len = size<sizeof(toybuf) ? size : sizeof(toybuf);
+    if (len != tar_read(tar, toybuf, len)) error_exit("short read");
+    if (dst>=0) xwrite(dst, toybuf, len);
   }
 }
 
@@ -103,26 +151,6 @@ static void itoo(char *str, int len, off_t val)
   memcpy(str, t, len);
 }
 
-static struct inode_list *seen_inode(void **list, struct stat *st, char *name)
-{
-  if (!st) llist_traverse(*list, llist_free_arg);
-  else if (!S_ISDIR(st->st_mode) && st->st_nlink > 1) {
-    struct inode_list *new;
-
-    for (new = *list; new; new = new->next)
-      if(new->ino == st->st_ino && new->dev == st->st_dev)
-        return new;
-
-    new = xzalloc(sizeof(*new));
-    new->ino = st->st_ino;
-    new->dev = st->st_dev;
-    new->arg = xstrdup(name);
-    new->next = *list;
-    *list = new;
-  }
-  return 0;
-}
-
 static void write_longname(struct archive_handler *tar, char *name, char type)
 {
   struct tar_hdr tmp;
@@ -144,10 +172,10 @@ static void write_longname(struct archive_handler *tar, char *name, char type)
   for (i= 0; i < 512; i++) sum += (unsigned int)((char*)&tmp)[i];
   itoo(tmp.chksum, sizeof(tmp.chksum)-1, sum);
 
-  writeall(tar->src_fd, (void*) &tmp, sizeof(tmp));
+  tar_write(tar, (void*) &tmp, sizeof(tmp));
   //write name to archive
-  writeall(tar->src_fd, name, sz);
-  if (sz%512) writeall(tar->src_fd, buf, (512-(sz%512)));
+  tar_write(tar, name, sz);
+  if (sz%512) tar_write(tar, buf, (512-(sz%512)));
 }
 
 static int filter(struct arg_list *lst, char *name)
@@ -159,15 +187,58 @@ static int filter(struct arg_list *lst, char *name)
   return 0;
 }
 
+// Index lines are "OFFSET NAME" with OFFSET of member's first header, or for
+// a gzip archive "OFFSET+SKIP NAME" where OFFSET is the gzip member to start
+// decompressing at and the header is SKIP bytes into its data. It's written
+// to a temp file renamed into place after a complete pass, so an interrupted
+// one can't leave behind a short index newer than the archive.
+static void index_zap(int sig)
+{
+  if (TT.idxtmp) unlink(TT.idxtmp);
+}
+
+// Names with newlines can't be indexed, so give up on the index.
+static void write_index(long long off, long long skip, char *name)
+{
+  if (!TT.idxfd) return;
+  if (strchr(name, '\n')) {
+    error_msg("can't index '%s'", name);
+    close(TT.idxfd);
+    index_zap(0);
+    TT.idxtmp = 0;
+    TT.idxfd = 0;
+  } else if (skip<0) dprintf(TT.idxfd, "%lld %s\n", off, name);
+  else dprintf(TT.idxfd, "%lld+%lld %s\n", off, skip, name);
+}
+
+static void read_index(char **pline, long len)
+{
+  char *line = *pline;
+  struct tar_index *ti;
+  int n = 0;
+
+  if (!(TT.idxlen&255))
+    TT.idx = xrealloc(TT.idx, (TT.idxlen+256)*sizeof(struct tar_index));
+  ti = TT.idx+TT.idxlen++;
+  line[len-1] = 0;
+  sscanf(line, "%lld+%lld %n", &ti->off, &ti->skip, &n);
+  if (n) toys.optflags |= FLAG_z;
+  else {
+    ti->skip = -1;
+    sscanf(line, "%lld %n", &ti->off, &n);
+  }
+  if (!n) error_exit("bad index %s", TT.index);
+  ti->name = xstrdup(line+n);
+}
+
 static void add_file(struct archive_handler *tar, char **nam, struct stat *st)
 {
   struct tar_hdr hdr;
-  struct passwd *pw;
-  struct group *gr;
-  struct inode_list *node;
+  struct dev_ino *node;
   int i, fd =-1;
   char *c, *p, *name = *nam, *lnk, *hname, buf[512] = {0,};
   unsigned int sum = 0;
+  long long off, skip = -1;
   static int warn = 1;
 
   for (p = name; *p; p++)
@@ -190,6 +261,14 @@ static void add_file(struct archive_handler *tar, char **nam, struct stat *st)
     warn = 0;
   }
 
+  off = 0;
+  if (TT.idxfd && !tar->codec) off = lseek(tar->src_fd, 0, SEEK_CUR);
+  else if (TT.idxfd) {
+    // Start a new gzip member every megabyte or so, for the index to point at.
+    gzip_member(tar->codec, &skip);
+    if (skip >= 1<<20) gzip_restart(tar->codec);
+    off = gzip_member(tar->codec, &skip);
+  }
   memset(&hdr, 0, sizeof(hdr));
   strncpy(hdr.name, hname, sizeof(hdr.name));
   itoo(hdr.mode, sizeof(hdr.mode), st->st_mode &07777);
@@ -202,9 +281,9 @@ static void add_file(struct archive_handler *tar, char **nam, struct stat *st)
   if ((node = seen_inode(&TT.inodes, st, hname))) {
     //this is a hard link
     hdr.type = '1';
-    if (strlen(node->arg) > sizeof(hdr.link))
+    if (strlen(node->name) > sizeof(hdr.link))
       write_longname(tar, hname, 'K'); //write longname LINK
-    xstrncpy(hdr.link, node->arg, sizeof(hdr.link));
+    xstrncpy(hdr.link, node->name, sizeof(hdr.link));
   } else if (S_ISREG(st->st_mode)) {
     hdr.type = '0';
     if (st->st_size <= (off_t)0777777777777LL)
@@ -238,19 +317,15 @@ static void add_file(struct archive_handler *tar, char **nam, struct stat *st)
   if (strlen(hname) > sizeof(hdr.name))
           write_longname(tar, hname, 'L'); //write longname NAME
   strcpy(hdr.magic, "ustar  ");
-  if ((pw = getpwuid(st->st_uid)))
-    snprintf(hdr.uname, sizeof(hdr.uname), "%s", pw->pw_name);
-  else snprintf(hdr.uname, sizeof(hdr.uname), "%d", st->st_uid);
-
-  if ((gr = getgrgid(st->st_gid)))
-    snprintf(hdr.gname, sizeof(hdr.gname), "%s", gr->gr_name);
-  else snprintf(hdr.gname, sizeof(hdr.gname), "%d", st->st_gid);
+  snprintf(hdr.uname, sizeof(hdr.uname), "%s", getusername(st->st_uid));
+  snprintf(hdr.gname, sizeof(hdr.gname), "%s", getgroupname(st->st_gid));
 
   //calculate chksum.
   for (i= 0; i < 512; i++) sum += (unsigned int)((char*)&hdr)[i];
   itoo(hdr.chksum, sizeof(hdr.chksum)-1, sum);
   if (toys.optflags & FLAG_v) printf("%s\n",hname);
-  writeall(tar->src_fd, (void*)&hdr, 512);
+  tar_write(tar, (void*)&hdr, 512);
+  write_index(off, skip, hname);
 
   //write actual data to archive
   if (hdr.type != '0') return; //nothing to write
@@ -258,8 +333,13 @@ static void add_file(struct archive_handler *tar, char **nam, struct stat *st)
     perror_msg("can't open '%s'", name);
     return;
   }
-  copy_in_out(fd, tar->src_fd, st->st_size);
-  if (st->st_size%512) writeall(tar->src_fd, buf, (512-(st->st_size%512)));
+  if (!tar->codec) xsendfile_len(fd, tar->src_fd, st->st_size);
+  else for (off = st->st_size; off; off -= i) {
+    i = off<sizeof(toybuf) ? off : sizeof(toybuf);
+    if (i != readall(fd, toybuf, i)) error_exit("short read %s", name);
+    gzip_write(tar->codec, toybuf, i);
+  }
+  if (st->st_size%512) tar_write(tar, buf, (512-(st->st_size%512)));
   close(fd);
 }
 
@@ -283,19 +363,25 @@ static int add_to_tar(struct dirtree *node)
   return ((DIRTREE_RECURSE | ((toys.optflags & FLAG_h)?DIRTREE_SYMFOLLOW:0)));
 }
 
+// Name of compressor for -j or -J. There's no builtin bzip2 or xz
+// compression, so those still run as a child process.
+static char *tar_codec(void)
+{
+  return (toys.optflags&FLAG_j) ? "bzip2" : "xz";
+}
+
 static void compress_stream(struct archive_handler *tar_hdl)
 {
   int pipefd[2];
-  pid_t cpid;
 
   xpipe(pipefd);
 
   signal(SIGPIPE, SIG_IGN);
-  cpid = fork();
-  if (cpid == -1) perror_exit("fork");
+  TT.cpid = fork();
+  if (TT.cpid == -1) perror_exit("fork");
 
-  if (!cpid) {    /* Child reads from pipe */
-    char *argv[] = {(toys.optflags&FLAG_z)?"gzip":"bzip2", "-f", NULL};
+  if (!TT.cpid) {    /* Child reads from pipe */
+    char *argv[] = {tar_codec(), "-f", NULL};
     xclose(pipefd[1]); /* Close unused write*/
     dup2(pipefd[0], 0);
     dup2(tar_hdl->src_fd, 1); //write to tar fd
@@ -303,6 +389,7 @@ static void compress_stream(struct archive_handler *tar_hdl)
   } else {
     xclose(pipefd[0]);          /* Close unused read end */
     dup2(pipefd[1], tar_hdl->src_fd); //write to pipe
+    xclose(pipefd[1]);
   }
 }
 
@@ -310,7 +397,7 @@ static void extract_to_stdout(struct archive_handler *tar)
 {
   struct file_header *file_hdr = &tar->file_hdr;
 
-  copy_in_out(tar->src_fd, 0, file_hdr->size);
+  copy_in_out(tar, 1, file_hdr->size);
   tar->offset += file_hdr->size;
 }
 
@@ -350,7 +437,7 @@ static void extract_to_command(struct archive_handler *tar)
     xexec(argv);
   } else {
     xclose(pipefd[0]);  // Close unused read end
-    copy_in_out(tar->src_fd, pipefd[1], file_hdr->size);
+    copy_in_out(tar, pipefd[1], file_hdr->size);
     tar->offset += file_hdr->size;
     xclose(pipefd[1]);
     waitpid(cpid, &status, 0);
@@ -359,11 +446,193 @@ static void extract_to_command(struct archive_handler *tar)
   }
 }
 
+// Memoize owner lookups: archives have few owners and lots of files.
+static unsigned tar_id(struct tar_id **list, char *name, unsigned id, int grp)
+{
+  struct tar_id *ti;
+
+  for (ti = *list; ti; ti = ti->next) if (!strcmp(ti->name, name)) break;
+  if (!ti) {
+    struct passwd *pw = 0;
+    struct group *gr = 0;
+
+    ti = xmalloc(sizeof(struct tar_id)+strlen(name)+1);
+    strcpy(ti->name, name);
+    if (grp) gr = getgrnam(name);
+    else pw = getpwnam(name);
+    ti->found = gr || pw;
+    ti->id = gr ? gr->gr_gid : pw ? pw->pw_uid : 0;
+    ti->next = *list;
+    *list = ti;
+  }
+
+  return ti->found ? ti->id : id;
+}
+
+// Create (or overwrite) regular file from data, or from archive if !data.
+static int extract_file(struct archive_handler *tar,
+  struct file_header *file_hdr, char *data)
+{
+  int flags = O_WRONLY|O_CREAT|O_EXCL, fd;
+
+  if (!(toys.optflags & FLAG_k) && unlink(file_hdr->name) && errno != ENOENT)
+    perror_msg("can't remove: %s", file_hdr->name);
+  if (toys.optflags & FLAG_overwrite) flags = O_WRONLY|O_CREAT|O_TRUNC;
+  if (-1 == (fd = open(file_hdr->name, flags, file_hdr->mode & 07777)))
+    perror_msg("%s: can't open", file_hdr->name);
+  else if (data && file_hdr->size != writeall(fd, data, file_hdr->size))
+    perror_msg("%s: write", file_hdr->name);
+  if (!data) copy_in_out(tar, fd, file_hdr->size);
+  if (fd != -1) close(fd);
+
+  return fd != -1;
+}
+
+// Apply ownership, permissions and mtime to extracted entry.
+static void extract_meta(struct file_header *file_hdr)
+{
+  if (S_ISLNK(file_hdr->mode)) return;
+  if (!(toys.optflags & FLAG_o) && chown(file_hdr->name, file_hdr->uid,
+      file_hdr->gid))
+    perror_msg("chown %d:%d '%s'", file_hdr->uid, file_hdr->gid, file_hdr->name);
+
+  if (toys.optflags & FLAG_p) // || !(toys.optflags & FLAG_no_same_permissions))
+    chmod(file_hdr->name, file_hdr->mode);
+
+  //apply mtime
+  if (!(toys.optflags & FLAG_m)) {
+    struct timeval times[2] = {{file_hdr->mtime, 0},{file_hdr->mtime, 0}};
+    utimes(file_hdr->name, times);
+  }
+}
+
+// Writer threads get small regular files with their data already read in.
+// The same name always goes to the same writer so later entries win, and
+// anything else waits for the writers to finish first (a hard link needs its
+// target written, a symlink may replace a file still in flight).
+
+struct tar_job {
+  struct tar_job *next;
+  struct file_header hdr;
+  char data[];
+};
+
+struct tar_pool {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  struct tar_writer {
+    pthread_t thread;
+    struct tar_job *jobs, **tail;
+  } *writers;
+  unsigned count, pending, done;
+  long long queued;
+};
+
+static void *tar_writer(void *arg)
+{
+  struct tar_pool *pool = TT.pool;
+  struct tar_writer *tw = arg;
+  struct tar_job *job;
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;) {
+    while (!(job = tw->jobs) && !pool->done)
+      pthread_cond_wait(&pool->cond, &pool->lock);
+    if (!job) break;
+    if (!(tw->jobs = job->next)) tw->tail = &tw->jobs;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (extract_file(0, &job->hdr, job->data)) extract_meta(&job->hdr);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->queued -= job->hdr.size;
+    pool->pending--;
+    pthread_cond_broadcast(&pool->cond);
+    free(job->hdr.name);
+    free(job);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return 0;
+}
+
+// Wait for queued files to be written, and if done stop the writers.
+static void tar_drain(int done)
+{
+  struct tar_pool *pool = TT.pool;
+  int i;
+
+  if (!pool) return;
+  pthread_mutex_lock(&pool->lock);
+  while (pool->pending) pthread_cond_wait(&pool->cond, &pool->lock);
+  if (done) {
+    pool->done++;
+    pthread_cond_broadcast(&pool->cond);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  if (!done) return;
+
+  for (i = 0; i<pool->count; i++) pthread_join(pool->writers[i].thread, 0);
+  free(pool->writers);
+  free(pool);
+  TT.pool = 0;
+}
+
+// Hand off a small regular file to writer threads, or return 0 to do it here.
+static int tar_queue(struct archive_handler *tar)
+{
+  struct file_header *file_hdr = &tar->file_hdr;
+  struct tar_pool *pool = TT.pool;
+  struct tar_job *job;
+  unsigned i, hash = 0;
+  long cpus;
+
+  if (file_hdr->size > 1<<20) return 0;
+  if (!pool) {
+    if (TT.nowriters || (cpus = sysconf(_SC_NPROCESSORS_ONLN)) < 2) {
+      TT.nowriters++;
+
+      return 0;
+    }
+    TT.pool = pool = xzalloc(sizeof(struct tar_pool));
+    pthread_mutex_init(&pool->lock, 0);
+    pthread_cond_init(&pool->cond, 0);
+    pool->count = cpus>8 ? 8 : cpus;
+    pool->writers = xzalloc(pool->count*sizeof(struct tar_writer));
+    for (i = 0; i<pool->count; i++) {
+      pool->writers[i].tail = &pool->writers[i].jobs;
+      if (pthread_create(&pool->writers[i].thread, 0, tar_writer,
+          pool->writers+i)) perror_exit("pthread_create");
+    }
+  }
+
+  job = xmalloc(sizeof(struct tar_job)+file_hdr->size);
+  if (tar_read(tar, job->data, file_hdr->size) != file_hdr->size)
+    error_exit("short read");
+  job->next = 0;
+  job->hdr = *file_hdr;
+  job->hdr.name = xstrdup(file_hdr->name);
+  job->hdr.link_target = job->hdr.uname = job->hdr.gname = 0;
+  for (i = 0; file_hdr->name[i]; i++) hash = hash*31+file_hdr->name[i];
+
+  // Don't read more than 32 megs ahead of the writers.
+  pthread_mutex_lock(&pool->lock);
+  while (pool->queued > 1<<25) pthread_cond_wait(&pool->cond, &pool->lock);
+  i = hash%pool->count;
+  *pool->writers[i].tail = job;
+  pool->writers[i].tail = &job->next;
+  pool->pending++;
+  pool->queued += file_hdr->size;
+  pthread_cond_broadcast(&pool->cond);
+  pthread_mutex_unlock(&pool->lock);
+
+  return 1;
+}
+
 static void extract_to_disk(struct archive_handler *tar)
 {
   int flags, dst_fd = -1;
   char *s;
-  struct stat ex;
   struct file_header *file_hdr = &tar->file_hdr;
 
   flags = strlen(file_hdr->name);
@@ -376,21 +645,44 @@ static void extract_to_disk(struct archive_handler *tar)
   }
 
   if (file_hdr->name[flags-1] == '/') file_hdr->name[flags-1] = 0;
-  //Regular file with preceding path
+  //Regular file with preceding path, skip if same directory as last time
   if ((s = strrchr(file_hdr->name, '/'))) {
-    if (mkpathat(AT_FDCWD, file_hdr->name, 00, 2) && errno !=EEXIST) {
-      error_msg(":%s: not created", file_hdr->name);
-      return;
+    if (!TT.lastdir || strncmp(TT.lastdir, file_hdr->name, s-file_hdr->name)
+        || TT.lastdir[s-file_hdr->name])
+    {
+      free(TT.lastdir);
+      TT.lastdir = 0;
+      if (mkpathat(AT_FDCWD, file_hdr->name, 00, 2) && errno !=EEXIST) {
+        error_msg(":%s: not created", file_hdr->name);
+        return;
+      }
+      TT.lastdir = xstrndup(file_hdr->name, s-file_hdr->name);
     }
   }
 
-  //remove old file, if exists
-  if (!(toys.optflags & FLAG_k) && !S_ISDIR(file_hdr->mode)
-      && !lstat( file_hdr->name, &ex)) {
-    if (unlink(file_hdr->name)) {
-      perror_msg("can't remove: %s",file_hdr->name);
+  //set ownership..., --no-same-owner, --numeric-owner
+  if (!(toys.optflags & (FLAG_o|FLAG_numeric_owner))) {
+    file_hdr->uid = tar_id(&TT.uids, file_hdr->uname, file_hdr->uid, 0);
+    file_hdr->gid = tar_id(&TT.gids, file_hdr->gname, file_hdr->gid, 1);
+  }
+
+  if (S_ISREG(file_hdr->mode) && !file_hdr->link_target) {
+    if (!tar_queue(tar)) {
+      tar_drain(0);
+      if (extract_file(tar, file_hdr, 0)) extract_meta(file_hdr);
     }
+    tar->offset += file_hdr->size;
+
+    return;
   }
+  // Even a directory, since its metadata mustn't be set before writers are
+  // done creating files in it.
+  tar_drain(0);
+
+  //remove old file, if exists
+  if (!(toys.optflags & FLAG_k) && !S_ISDIR(file_hdr->mode)
+      && unlink(file_hdr->name) && errno != ENOENT)
+    perror_msg("can't remove: %s",file_hdr->name);
 
   //hard link
   if (S_ISREG(file_hdr->mode) && file_hdr->link_target) {
@@ -400,12 +692,6 @@ static void extract_to_disk(struct archive_handler *tar)
   }
 
   switch (file_hdr->mode & S_IFMT) {
-    case S_IFREG:
-      flags = O_WRONLY|O_CREAT|O_EXCL;
-      if (toys.optflags & FLAG_overwrite) flags = O_WRONLY|O_CREAT|O_TRUNC;
-      dst_fd = open(file_hdr->name, flags, file_hdr->mode & 07777);
-      if (dst_fd == -1) perror_msg("%s: can't open", file_hdr->name);
-      break;
     case S_IFDIR:
       if ((mkdir(file_hdr->name, file_hdr->mode) == -1) && errno != EEXIST)
         perror_msg("%s: can't create", file_hdr->name);
@@ -427,34 +713,9 @@ static void extract_to_disk(struct archive_handler *tar)
 
   //copy file....
 COPY:
-  copy_in_out(tar->src_fd, dst_fd, file_hdr->size);
+  copy_in_out(tar, dst_fd, file_hdr->size);
   tar->offset += file_hdr->size;
-  close(dst_fd);
-
-  if (S_ISLNK(file_hdr->mode)) return;
-  if (!(toys.optflags & FLAG_o)) {
-    //set ownership..., --no-same-owner, --numeric-owner
-    uid_t u = file_hdr->uid;
-    gid_t g = file_hdr->gid;
-
-    if (!(toys.optflags & FLAG_numeric_owner)) {
-      struct group *gr = getgrnam(file_hdr->gname);
-      struct passwd *pw = getpwnam(file_hdr->uname);
-      if (pw) u = pw->pw_uid;
-      if (gr) g = gr->gr_gid;
-    }
-    if (chown(file_hdr->name, u, g))
-      perror_msg("chown %d:%d '%s'", u, g, file_hdr->name);;
-  }
-
-  if (toys.optflags & FLAG_p) // || !(toys.optflags & FLAG_no_same_permissions))
-    chmod(file_hdr->name, file_hdr->mode);
-
-  //apply mtime
-  if (!(toys.optflags & FLAG_m)) {
-    struct timeval times[2] = {{file_hdr->mtime, 0},{file_hdr->mtime, 0}};
-    utimes(file_hdr->name, times);
-  }
+  extract_meta(file_hdr);
 }
 
 static void add_to_list(struct arg_list **llist, char *name)
@@ -506,34 +767,22 @@ static int otoi(char *str, int len)
   return (int)val;
 }
 
-static void extract_stream(struct archive_handler *tar_hdl)
+// Decompress the rest of the archive as we read it, -z, -j or -J saying how.
+// The first len bytes of it were already read into pre.
+static void extract_stream(struct archive_handler *tar_hdl, char *pre, int len)
 {
-  int pipefd[2];              
-  pid_t cpid;                 
-
-  xpipe(pipefd);
-
-  cpid = fork();
-  if (cpid == -1) perror_exit("fork");
+  int fd = tar_hdl->src_fd;
 
-  if (!cpid) {    /* Child reads from pipe */
-    char *argv[] =
-      {(toys.optflags&FLAG_z)?"gunzip":"bunzip2", "-cf", "-", NULL};
-    xclose(pipefd[0]); /* Close unused read*/
-    dup2(tar_hdl->src_fd, 0);
-    dup2(pipefd[1], 1); //write to pipe
-    xexec(argv);
-  } else {
-    xclose(pipefd[1]);          /* Close unused read end */
-    dup2(pipefd[0], tar_hdl->src_fd); //read from pipe
-  }
+  if (toys.optflags & FLAG_z) tar_hdl->codec = gunzip_open(fd, pre, len);
+  else if (toys.optflags & FLAG_j) tar_hdl->codec = bunzip_open(fd, pre, len);
+  else tar_hdl->codec = unxz_open(fd, pre, len);
 }
 
 static char *process_extended_hdr(struct archive_handler *tar, int size)
 {
   char *value = NULL, *p, *buf = xzalloc(size+1);
 
-  if (readall(tar->src_fd, buf, size) != size) error_exit("short read");
+  if (tar_read(tar, buf, size) != size) error_exit("short read");
   buf[size] = 0;
   tar->offset += size;
   p = buf;
@@ -568,6 +817,12 @@ static void tar_skip(struct archive_handler *tar, int sz)
 {
   int x;
 
+  if (tar->codec) {
+    copy_in_out(tar, -1, sz);
+    tar->offset += sz;
+
+    return;
+  }
   while ((x = lskip(tar->src_fd, sz))) {
     tar->offset += sz - x;
     sz = x;
@@ -581,7 +836,8 @@ static void unpack_tar(struct archive_handler *tar_hdl)
   struct file_header *file_hdr;
   int i, j, maj, min, sz, e = 0;
   unsigned int cksum;
-  char *longname = NULL, *longlink = NULL;
+  char *longname = NULL, *longlink = NULL, *want = 0;
+  long long start = 0, skip = -1;
 
   while (1) {
     cksum = 0;
@@ -589,28 +845,78 @@ static void unpack_tar(struct archive_handler *tar_hdl)
       sz = 512 - tar_hdl->offset % 512;
       tar_skip(tar_hdl, sz);
     }
-    i = readall(tar_hdl->src_fd, &tar, 512);
+
+    // Start of next member (not a name header for the member we're reading).
+    // With an index, seek to next one we want.
+    if (!longname && !longlink) {
+      if (TT.idx) {
+        struct tar_index *ti;
+
+        for (;; TT.idxpos++) {
+          if (TT.idxpos == TT.idxlen) return;
+          ti = TT.idx+TT.idxpos;
+          if (!filter(TT.exc, ti->name) && (!TT.inc || filter(TT.inc, ti->name)))
+            break;
+        }
+        want = ti->name;
+        TT.idxpos++;
+        if (ti->skip<0)
+          tar_hdl->offset = xlseek(tar_hdl->src_fd, ti->off, SEEK_SET);
+        else {
+          // Restart at the gzip member unless we're already in it.
+          if (gzip_member(tar_hdl->codec, &skip) != ti->off
+              || skip > ti->skip)
+          {
+            gunzip_close(tar_hdl->codec);
+            if (2 != pread(tar_hdl->src_fd, toybuf, 2, ti->off)
+                || memcmp(toybuf, "\x1f\x8b", 2))
+              error_exit("stale index %s", TT.index);
+            xlseek(tar_hdl->src_fd, ti->off, SEEK_SET);
+            tar_hdl->codec = gunzip_open(tar_hdl->src_fd, 0, 0);
+            skip = 0;
+          }
+          for (skip = ti->skip-skip; skip; skip -= i) {
+            i = skip<sizeof(toybuf) ? skip : sizeof(toybuf);
+            if (i != tar_read(tar_hdl, toybuf, i))
+              error_exit("stale index %s", TT.index);
+            tar_hdl->offset += i;
+          }
+        }
+      }
+      if (TT.idxfd && tar_hdl->codec)
+        start = gzip_member(tar_hdl->codec, &skip);
+      else start = tar_hdl->offset;
+    }
+    i = tar_read(tar_hdl, (char *)&tar, 512);
     tar_hdl->offset += i;
     if (i != 512) {
       if (i >= 2) goto CHECK_MAGIC; //may be a small (<512 byte)zipped file
+      if (want) error_exit("stale index %s", TT.index);
       error_exit("read error");
     }
 
     if (!tar.name[0]) {
+      if (want) error_exit("stale index %s", TT.index);
       if (e) return; //end of tar 2 empty blocks
       e = 1;//empty jump to next block
       continue;
     }
     if (strncmp(tar.magic, "ustar", 5)) {
-      // Try detecting .gz or .bz2 by looking for their magic.
+      // Try detecting .gz, .bz2 or .xz by looking for their magic.
 CHECK_MAGIC:
-      if ((!strncmp(tar.name, "\x1f\x8b", 2) || !strncmp(tar.name, "BZh", 3))
-          && !lseek(tar_hdl->src_fd, -i, SEEK_CUR)) {
-        toys.optflags |= (*tar.name == 'B') ? FLAG_j : FLAG_z;
+      if (TT.index && (!strncmp(tar.name, "BZh", 3)
+          || !memcmp(tar.name, "\xfd""7zXZ", 5)))
+        error_exit("--index needs uncompressed or gzip archive");
+      if (!tar_hdl->codec && (!strncmp(tar.name, "\x1f\x8b", 2)
+          || !strncmp(tar.name, "BZh", 3) || !memcmp(tar.name, "\xfd""7zXZ", 5)))
+      {
+        toys.optflags |= (*tar.name == 'B') ? FLAG_j
+          : (*tar.name == '\x1f') ? FLAG_z : FLAG_J;
         tar_hdl->offset -= i;
-        extract_stream(tar_hdl);
+        extract_stream(tar_hdl, (char *)&tar, i);
         continue;
       }
+      if (want) error_exit("stale index %s", TT.index);
       error_exit("invalid tar format");
     }
 
@@ -677,13 +983,15 @@ CHECK_MAGIC:
         break;
       case 'K':
         longlink = xzalloc(file_hdr->size +1);
-        xread(tar_hdl->src_fd, longlink, file_hdr->size);
+        if (tar_read(tar_hdl, longlink, file_hdr->size) != file_hdr->size)
+          error_exit("short read");
         tar_hdl->offset += file_hdr->size;
         continue;
       case 'L':
         free(longname);
         longname = xzalloc(file_hdr->size +1);           
-        xread(tar_hdl->src_fd, longname, file_hdr->size);
+        if (tar_read(tar_hdl, longname, file_hdr->size) != file_hdr->size)
+          error_exit("short read");
         tar_hdl->offset += file_hdr->size;
         continue;
       case 'D':
@@ -723,6 +1031,11 @@ CHECK_MAGIC:
         || S_ISLNK(file_hdr->mode) || S_ISDIR(file_hdr->mode))
       file_hdr->size = 0;
 
+    // An index from another archive, or rewritten within the same mtime tick,
+    // can point at the wrong member.
+    if (want && strcmp(want, file_hdr->name))
+      error_exit("stale index %s", TT.index);
+    write_index(start, skip, file_hdr->name);
     if (filter(TT.exc, file_hdr->name) ||
         (TT.inc && !filter(TT.inc, file_hdr->name))) goto SKIP;
     add_to_list(&TT.pass, xstrdup(file_hdr->name));
@@ -775,6 +1088,33 @@ void tar_main(void)
   }
   if ((toys.optflags & FLAG_f) && strcmp(TT.fname, "-")) 
     fd = xcreate(TT.fname, fd*(O_WRONLY|O_CREAT|O_TRUNC), 0666);
+
+  // Use existing index if it's at least as new as the archive, else write one
+  if (TT.index) {
+    struct stat st, ist;
+
+    // Temp file gets renamed after -C changes directory.
+    if ((toys.optflags & FLAG_C) && !(TT.index = xabspath(TT.index, 0)))
+      perror_exit("--index");
+
+    if (toys.optflags & (FLAG_j|FLAG_J))
+      error_exit("--index needs uncompressed or gzip archive");
+    if (!(toys.optflags & FLAG_c) && !fstat(fd, &st) && S_ISREG(st.st_mode)
+        && !stat(TT.index, &ist) && (ist.st_mtim.tv_sec > st.st_mtim.tv_sec
+          || (ist.st_mtim.tv_sec == st.st_mtim.tv_sec
+            && ist.st_mtim.tv_nsec >= st.st_mtim.tv_nsec)))
+    {
+      do_lines(xopen(TT.index, O_RDONLY), read_index);
+    } else {
+      if ((toys.optflags & FLAG_c) && lseek(fd, 0, SEEK_CUR)<0)
+        error_exit("--index needs seekable archive");
+      TT.idxtmp = xmprintf("%sXXXXXX", TT.index);
+      if (-1 == (TT.idxfd = mkstemp(TT.idxtmp))) perror_exit("%s", TT.idxtmp);
+      fchmod(TT.idxfd, 0644);
+      sigatexit(index_zap);
+    }
+  }
+
   if (toys.optflags & FLAG_C) xchdir(TT.dir);
 
   tar_hdl = init_handler();
@@ -786,14 +1126,25 @@ void tar_main(void)
       signal(SIGPIPE, SIG_IGN); //will be using pipe between child & parent
       tar_hdl->extract_handler = extract_to_command;
     }
-    if (toys.optflags & FLAG_z) extract_stream(tar_hdl);
+    if (toys.optflags & (FLAG_z|FLAG_j|FLAG_J)) extract_stream(tar_hdl, 0, 0);
     unpack_tar(tar_hdl);
+    tar_drain(1);
+
+    // Decompress to the end so the trailer's crc gets checked, unless the
+    // index let us skip most of it.
+    if (tar_hdl->codec) {
+      if (!TT.idx) while (tar_read(tar_hdl, toybuf, sizeof(toybuf)));
+      if (toys.optflags & FLAG_z) gunzip_close(tar_hdl->codec);
+      else if (toys.optflags & FLAG_j) bunzip_close(tar_hdl->codec);
+      else unxz_close(tar_hdl->codec);
+    }
     for (tmp = TT.inc; tmp; tmp = tmp->next)
       if (!filter(TT.exc, tmp->arg) && !filter(TT.pass, tmp->arg))
         error_msg("'%s' not in archive", tmp->arg);
   } else if (toys.optflags & FLAG_c) {
     //create the tar here.
-    if (toys.optflags & (FLAG_j|FLAG_z)) compress_stream(tar_hdl);
+    if (toys.optflags & FLAG_z) tar_hdl->codec = gzip_open(fd, 6);
+    else if (toys.optflags & (FLAG_j|FLAG_J)) compress_stream(tar_hdl);
     for (tmp = TT.inc; tmp; tmp = tmp->next) {
       TT.handle = tar_hdl;
       //recurse thru dir and add files to archive
@@ -801,8 +1152,32 @@ void tar_main(void)
         add_to_tar);
     }
     memset(toybuf, 0, 1024);
-    writeall(tar_hdl->src_fd, toybuf, 1024);
+    tar_write(tar_hdl, toybuf, 1024);
     seen_inode(&TT.inodes, 0, 0);
+    if (tar_hdl->codec) gzip_close(tar_hdl->codec);
+  }
+
+  // Index has to end up newer than the archive it describes
+  if (TT.idxfd) {
+    futimens(TT.idxfd, 0);
+    close(TT.idxfd);
+    if (rename(TT.idxtmp, TT.index)) {
+      perror_msg("%s", TT.index);
+      index_zap(0);
+    }
+    free(TT.idxtmp);
+    TT.idxtmp = 0;
+  }
+
+  // Let the compressor finish the archive before we exit.
+  if (TT.cpid) {
+    int status;
+
+    close(tar_hdl->src_fd);
+    tar_hdl->src_fd = -1;
+    waitpid(TT.cpid, &status, 0);
+    if (WIFSIGNALED(status) || WEXITSTATUS(status))
+      error_msg("%s failed", tar_codec());
   }
 
   if (CFG_TOYBOX_FREE) {
@@ -811,5 +1186,8 @@ void tar_main(void)
     llist_traverse(TT.exc, llist_free_arg);
     llist_traverse(TT.inc, llist_free_arg);
     llist_traverse(TT.pass, llist_free_arg);
+    llist_traverse(TT.uids, free);
+    llist_traverse(TT.gids, free);
+    free(TT.lastdir);
   }
 }
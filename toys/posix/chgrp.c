@@ -66,7 +66,7 @@ static int do_chgrp(struct dirtree *node)
       perror_msg("'%s' to '%s:%s'", path, TT.owner_name, TT.group_name);
     free(path);
   }
-  toys.exitval |= ret;
+  if (ret) toys.exitval |= ret;
 
   return 0;
 }
@@ -93,9 +93,10 @@ void chgrp_main(void)
   if (TT.group_name && *TT.group_name)
     TT.group = xgetgid(TT.group_name);
 
+  // -v output should come out in order, else chown directories in parallel
   for (s=toys.optargs+1; *s; s++)
-    dirtree_flagread(*s, DIRTREE_SYMFOLLOW*!!(toys.optflags&(FLAG_H|FLAG_L)),
-      do_chgrp);
+    dirtree_flagread(*s, DIRTREE_SYMFOLLOW*!!(toys.optflags&(FLAG_H|FLAG_L))
+      |DIRTREE_PARALLEL*!(toys.optflags&FLAG_v), do_chgrp);
 
   if (CFG_TOYBOX_FREE && ischown) free(own);
 }
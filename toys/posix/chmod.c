@@ -61,5 +61,7 @@ void chmod_main(void)
   TT.mode = *toys.optargs;
   char **file;
 
-  for (file = toys.optargs+1; *file; file++) dirtree_read(*file, do_chmod);
+  // -v output should come out in order, else chmod directories in parallel
+  for (file = toys.optargs+1; *file; file++)
+    dirtree_flagread(*file, DIRTREE_PARALLEL*!(toys.optflags&FLAG_v), do_chmod);
 }
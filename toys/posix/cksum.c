@@ -26,47 +26,33 @@ config CKSUM
 #include "toys.h"
 
 GLOBALS(
-  unsigned crc_table[256];
+  unsigned crc_table[8*256];
 )
 
-static unsigned cksum_be(unsigned crc, unsigned char c)
-{
-  return (crc<<8)^TT.crc_table[(crc>>24)^c];
-}
-
-static unsigned cksum_le(unsigned crc, unsigned char c)
-{
-  return TT.crc_table[(crc^c)&0xff] ^ (crc>>8);
-}
-
 static void do_cksum(int fd, char *name)
 {
   unsigned crc = (toys.optflags & FLAG_P) ? 0xffffffff : 0;
   uint64_t llen = 0, llen2;
-  unsigned (*cksum)(unsigned crc, unsigned char c);
+  int le = toys.optflags & FLAG_L, len;
+  char buf[8];
 
-  cksum = (toys.optflags & FLAG_L) ? cksum_le : cksum_be;
   // CRC the data
 
   for (;;) {
-    int len, i;
-
     len = read(fd, toybuf, sizeof(toybuf));
     if (len<0) perror_msg_raw(name);
     if (len<1) break;
 
     llen += len;
-    for (i=0; i<len; i++) crc=cksum(crc, toybuf[i]);
+    crc = crc_update(TT.crc_table, le, crc, toybuf, len);
   }
 
   // CRC the length
 
   llen2 = llen;
   if (!(toys.optflags & FLAG_N)) {
-    while (llen) {
-      crc = cksum(crc, llen);
-      llen >>= 8;
-    }
+    for (len = 0; llen; llen >>= 8) buf[len++] = llen;
+    crc = crc_update(TT.crc_table, le, crc, buf, len);
   }
 
   printf((toys.optflags & FLAG_H) ? "%x" : "%u",
@@ -78,6 +64,6 @@ static void do_cksum(int fd, char *name)
 
 void cksum_main(void)
 {
-  crc_init(TT.crc_table, toys.optflags & FLAG_L);
+  crc_init8(TT.crc_table, toys.optflags & FLAG_L);
   loopfiles(toys.optargs, do_cksum);
 }
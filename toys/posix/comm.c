@@ -39,17 +39,28 @@ static void writeline(const char *line, int col)
   puts(line);
 }
 
+// Next line from reader as a view into its buffer, with newline removed.
+static char *next_line(struct linebuf *lb)
+{
+  long len;
+  char *s = linebuf_next(lb, &len, '\n');
+
+  if (s && s[len-1]=='\n') s[len-1] = 0;
+
+  return s;
+}
+
 void comm_main(void)
 {
-  int file[2];
+  struct linebuf *file[2];
   char *line[2];
   int i;
 
   if (toys.optflags == 7) return;
 
   for (i = 0; i < 2; i++) {
-    file[i] = xopenro(toys.optargs[i]);
-    line[i] = get_line(file[i]);
+    file[i] = linebuf_new(xopenro(toys.optargs[i]));
+    line[i] = next_line(file[i]);
   }
 
   while (line[0] && line[1]) {
@@ -57,24 +68,22 @@ void comm_main(void)
 
     if (order == 0) {
       writeline(line[0], 2);
-      for (i = 0; i < 2; i++) {
-        free(line[i]);
-        line[i] = get_line(file[i]);
-      }
+      for (i = 0; i < 2; i++) line[i] = next_line(file[i]);
     } else {
       i = order < 0 ? 0 : 1;
       writeline(line[i], i);
-      free(line[i]);
-      line[i] = get_line(file[i]);
+      line[i] = next_line(file[i]);
     }
   }
 
   /* print rest of the longer file */
   for (i = line[0] ? 0 : 1; line[i];) {
     writeline(line[i], i);
-    free(line[i]);
-    line[i] = get_line(file[i]);
+    line[i] = next_line(file[i]);
   }
 
-  if (CFG_TOYBOX_FREE) for (i = 0; i < 2; i++) xclose(file[i]);
+  if (CFG_TOYBOX_FREE) for (i = 0; i < 2; i++) {
+    xclose(file[i]->fd);
+    linebuf_free(file[i]);
+  }
 }
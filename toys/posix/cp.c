@@ -9,7 +9,6 @@
  * Deviations from posix: -adlnrsvF, --preserve... about half the
  * functionality in this cp isn't in posix. Posix is stuck in the 1970's.
  *
- * TODO: --preserve=links
  * TODO: what's this _CP_mode system.posix_acl_ business? We chmod()?
 
 // options shared between mv/cp must be in same order (right to left)
@@ -36,7 +35,7 @@ config CP
     -H	Follow symlinks listed on command line
     -L	Follow all symlinks
     -P	Do not follow symlinks [default]
-    -a	same as -dpr
+    -a	same as -dpr, plus keep hardlinked files hardlinked
     -d	don't dereference symlinks
     -l	hard link instead of copy
     -n	no clobber (don't overwrite DEST)
@@ -49,7 +48,7 @@ config CP_PRESERVE
   default y
   depends on CP
   help
-    usage: cp [--preserve=motcxa]
+    usage: cp [--preserve=motcxla]
 
     --preserve takes either a comma separated list of attributes, or the first
     letter(s) of:
@@ -59,6 +58,7 @@ config CP_PRESERVE
       timestamps - file creation, modification, and access times.
          context - security context
            xattr - extended attributes
+           links - hardlinked files stay hardlinked in the copy
              all - all of the above
 
 config MV
@@ -108,6 +108,7 @@ GLOBALS(
   };
 
   char *destname;
+  void *links;
   struct stat top;
   int (*callback)(struct dirtree *try);
   uid_t uid;
@@ -119,8 +120,34 @@ struct cp_preserve {
   char *name;
 } static const cp_preserve[] = TAGGED_ARRAY(CP,
   {"mode"}, {"ownership"}, {"timestamps"}, {"context"}, {"xattr"},
+  {"links"},
 );
 
+// Path under TT.destname a node in the source tree is copied to.
+static char *cp_destpath(struct dirtree *try)
+{
+  char *f = dirtree_path(try, 0), *s;
+
+  while (try->parent) try = try->parent;
+  s = xmprintf("%s%s", TT.destname, f+strlen(try->name));
+  free(f);
+
+  return s;
+}
+
+// Return the copy of an already seen hardlinked file, else remember this one.
+static struct dev_ino *cp_seen(struct dirtree *try)
+{
+  struct dev_ino *link;
+  char *s;
+
+  if (try->st.st_nlink<2) return 0;
+  link = seen_inode(&TT.links, &try->st, s = cp_destpath(try));
+  free(s);
+
+  return link;
+}
+
 // Callback from dirtree_read() for each file/directory under a source dir.
 
 static int cp_node(struct dirtree *try)
@@ -129,6 +156,7 @@ static int cp_node(struct dirtree *try)
       tfd = dirtree_parentfd(try);
   unsigned flags = toys.optflags;
   char *catch = try->parent ? try->name : TT.destname, *err = "%s";
+  struct dev_ino *link = 0;
   struct stat cst;
 
   if (!dirtree_notdotdot(try)) return 0;
@@ -182,6 +210,10 @@ static int cp_node(struct dirtree *try)
       free(s);
     }
 
+    // Look up hardlinks before the loop, a retry would find this one.
+    if ((TT.pflags&_CP_links) && !S_ISDIR(try->st.st_mode) && !(flags&FLAG_l))
+      link = cp_seen(try);
+
     // Loop for -f retry after unlink
     do {
 
@@ -216,6 +248,10 @@ static int cp_node(struct dirtree *try)
       } else if (flags & FLAG_l) {
         if (!linkat(tfd, try->name, cfd, catch, 0)) err = 0;
 
+      // Link to our copy of a file we've already seen under another name.
+      } else if (link) {
+        if (!linkat(AT_FDCWD, link->name, cfd, catch, 0)) err = 0;
+
       // Copy tree as symlinks. For non-absolute paths this involves
       // appending the right number of .. entries as you go down the tree.
 
@@ -270,7 +306,7 @@ static int cp_node(struct dirtree *try)
         }
         fdout = openat(cfd, catch, O_RDWR|O_CREAT|O_TRUNC, try->st.st_mode);
         if (fdout >= 0) {
-          xsendfile(fdin, fdout);
+          xcopyfile(fdin, fdout);
           err = 0;
         }
 
@@ -348,13 +384,7 @@ static int cp_node(struct dirtree *try)
   if (err) {
     char *f = 0;
 
-    if (catch == try->name) {
-      f = dirtree_path(try, 0);
-      while (try->parent) try = try->parent;
-      catch = xmprintf("%s%s", TT.destname, f+strlen(try->name));
-      free(f);
-      f = catch;
-    }
+    if (catch == try->name) catch = f = cp_destpath(try);
     perror_msg(err, catch);
     free(f);
   }
@@ -369,7 +399,8 @@ void cp_main(void)
   if (toys.optc>1 && !destdir) error_exit("'%s' not directory", destname);
 
   if (toys.optflags & (FLAG_a|FLAG_p)) {
-    TT.pflags = CP_mode|CP_ownership|CP_timestamps;
+    TT.pflags = _CP_mode|_CP_ownership|_CP_timestamps;
+    if (toys.optflags & FLAG_a) TT.pflags |= _CP_links;
     umask(0);
   }
   // Not using comma_args() (yet?) because interpeting as letters.
@@ -435,6 +466,7 @@ void cp_main(void)
     }
     if (destdir) free(TT.destname);
   }
+  if (CFG_TOYBOX_FREE) seen_inode(&TT.links, 0, 0);
 }
 
 void mv_main(void)
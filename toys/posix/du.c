@@ -42,6 +42,7 @@ GLOBALS(
   unsigned long depth, total;
   dev_t st_dev;
   void *inodes;
+  pthread_mutex_t lock;
 )
 
 typedef struct node_size {
@@ -72,37 +73,6 @@ static void print(long long size, struct dirtree *node)
   if (node) free(name);
 }
 
-// Return whether or not we've seen this inode+dev, adding it to the list if
-// we haven't.
-static int seen_inode(void **list, struct stat *st)
-{
-  if (!st) llist_traverse(st, free);
-
-  // Skipping dir nodes isn't _quite_ right. They're not hardlinked, but could
-  // be bind mounted. Still, it's more efficient and the archivers can't use
-  // hardlinked directory info anyway. (Note that we don't catch bind mounted
-  // _files_ because it doesn't change st_nlink.)
-  else if (!S_ISDIR(st->st_mode) && st->st_nlink > 1) {
-    struct inode_list {
-      struct inode_list *next;
-      ino_t ino;
-      dev_t dev;
-    } *new;
-
-    for (new = *list; new; new = new->next)
-      if(new->ino == st->st_ino && new->dev == st->st_dev)
-        return 1;
-
-    new = xzalloc(sizeof(*new));
-    new->ino = st->st_ino;
-    new->dev = st->st_dev;
-    new->next = *list;
-    *list = new;
-  }
-
-  return 0;
-}
-
 // dirtree callback, compute/display size of node
 static int do_du(struct dirtree *node)
 {
@@ -126,7 +96,7 @@ static int do_du(struct dirtree *node)
 
   // Don't count hard links twice
   if (!(toys.optflags & FLAG_l) && !node->again)
-    if (seen_inode(&TT.inodes, &node->st)) return 0;
+    if (seen_inode(&TT.inodes, &node->st, 0)) return 0;
 
   // Collect child info before printing directory size
   if (S_ISDIR(node->st.st_mode)) {
@@ -154,15 +124,31 @@ static int do_du(struct dirtree *node)
   return 0;
 }
 
+// For dirtree_parallel(): stat() and readdir() in parallel, add up serially.
+static int do_du_locked(struct dirtree *node)
+{
+  int ret;
+
+  pthread_mutex_lock(&TT.lock);
+  ret = do_du(node);
+  pthread_mutex_unlock(&TT.lock);
+
+  return ret;
+}
+
 void du_main(void)
 {
   char *noargs[] = {".", 0}, **args;
+  int par = (toys.optflags&(FLAG_s|FLAG_a)) == FLAG_s;
+
+  // Only -s output is independent of the order we see files in.
+  if (par) pthread_mutex_init(&TT.lock, 0);
 
   // Loop over command line arguments, recursing through children
   for (args = toys.optc ? toys.optargs : noargs; *args; args++)
-    dirtree_flagread(*args, DIRTREE_SYMFOLLOW*!!(toys.optflags&(FLAG_H|FLAG_L)),
-      do_du);
+    dirtree_flagread(*args, DIRTREE_SYMFOLLOW*!!(toys.optflags&(FLAG_H|FLAG_L))
+      |DIRTREE_PARALLEL*par, par ? do_du_locked : do_du);
   if (toys.optflags & FLAG_c) print(TT.total*512, 0);
 
-  if (CFG_TOYBOX_FREE) seen_inode(TT.inodes, 0);
+  if (CFG_TOYBOX_FREE) seen_inode(&TT.inodes, 0, 0);
 }
@@ -10,18 +10,19 @@
  *
  * TODO: -empty (dirs too!)
 
-USE_FIND(NEWTOY(find, "?^HL[-HL]", TOYFLAG_USR|TOYFLAG_BIN))
+USE_FIND(NEWTOY(find, "?^j#<1HL[-HL]", TOYFLAG_USR|TOYFLAG_BIN))
 
 config FIND
   bool "find"
   default y
   help
-    usage: find [-HL] [DIR...] [<options>]
+    usage: find [-HL] [-j N] [DIR...] [<options>]
 
     Search directories for matching files.
     Default: search "." match all -print all matches.
 
     -H  Follow command line symlinks         -L  Follow all symlinks
+    -j  Run up to N "-exec +" commands at once
 
     Match filters:
     -name  PATTERN  filename with wildcards   -iname      case insensitive -name
@@ -57,9 +58,11 @@ config FIND
 #include "toys.h"
 
 GLOBALS(
+  long j;
+
   char **filter;
   struct double_list *argdata;
-  int topdir, xdev, depth;
+  int topdir, xdev, depth, running;
   time_t now;
 )
 
@@ -79,6 +82,20 @@ struct exec_range {
   struct execdir_data exec, *execdir;
 };
 
+// Reap one "-exec +" command started in the background by flush_exec()
+static void exec_wait(void)
+{
+  int status;
+
+  if (-1 == waitpid(-1, &status, 0)) {
+    if (errno != EINTR) TT.running = 0;
+
+    return;
+  }
+  TT.running--;
+  toys.exitval |= WIFEXITED(status) ? WEXITSTATUS(status) : WTERMSIG(status)+127;
+}
+
 // Perform pending -exec (if any)
 static int flush_exec(struct dirtree *new, struct exec_range *aa)
 {
@@ -91,11 +108,13 @@ static int flush_exec(struct dirtree *new, struct exec_range *aa)
   dlist_terminate(bb->names);
 
   // switch to directory for -execdir, or back to top if we have an -execdir
-  // _and_ a normal -exec, or are at top of tree in -execdir
+  // _and_ a normal -exec, or are at top of tree in -execdir. When leaving a
+  // directory (COMEAGAIN) its names were collected in new itself, otherwise
+  // new is the entry that overflowed the batch and they're in its parent.
   if (TT.topdir != -1) {
-    if (aa->dir && new && new->parent) {
+    if (aa->dir && new && (new->again || new->parent)) {
       revert++;
-      rc = fchdir(new->parent->dirfd);
+      rc = fchdir(new->again ? new->dirfd : new->parent->dirfd);
     } else rc = fchdir(TT.topdir);
     if (rc) {
       perror_msg_raw(revert ? new->name : ".");
@@ -121,7 +140,16 @@ static int flush_exec(struct dirtree *new, struct exec_range *aa)
     newargs[pos+rest] = 0;
   }
 
-  rc = xrun(newargs);
+  // With -j, "+" batches run in the background (after the fchdir above, so
+  // -execdir children still start in the right directory) and report
+  // failure through exitval when reaped.
+  if (aa->plus && TT.j > 1) {
+    while (TT.running >= TT.j) exec_wait();
+    xpopen_both(newargs, 0);
+    TT.running++;
+    rc = 0;
+  } else rc = xrun(newargs);
+  free(newargs);
 
   llist_traverse(bb->names, llist_free_double);
   bb->names = 0;
@@ -156,6 +184,20 @@ static void do_print(struct dirtree *new, char c)
   free(s);
 }
 
+// Tests that need more of stat() than DIRTREE_STATLESS fills in
+static int needs_stat(char *s)
+{
+  char *stats[] = {"nouser", "nogroup", "perm", "size", "links", "inum", "user",
+    "group", "newer"};
+  int i;
+
+  if (strchr("acm", *s) && (!strcmp(s+1, "time") || !strcmp(s+1, "min")))
+    return 1;
+  for (i = 0; i<ARRAY_LEN(stats); i++) if (!strcmp(s, stats[i])) return 1;
+
+  return 0;
+}
+
 // Descend or ascend -execdir + directory level
 static void execdir(struct dirtree *new, int flush)
 {
@@ -201,7 +243,8 @@ static int do_find(struct dirtree *new)
   struct double_list *argdata = TT.argdata;
   char *s, **ss;
 
-  recurse = DIRTREE_COMEAGAIN|(DIRTREE_SYMFOLLOW*!!(toys.optflags&FLAG_L));
+  recurse = DIRTREE_COMEAGAIN|DIRTREE_STATLESS
+    |(DIRTREE_SYMFOLLOW*!!(toys.optflags&FLAG_L));
 
   // skip . and .. below topdir, handle -xdev and -depth
   if (new) {
@@ -278,6 +321,9 @@ static int do_find(struct dirtree *new)
       continue;
     } else s++;
 
+    // Children come from getdents with just type, stat them when a test asks
+    if (new && check && needs_stat(s) && dirtree_stat(new)) check = test = 0;
+
     if (!strcmp(s, "xdev")) TT.xdev = 1;
     else if (!strcmp(s, "delete")) {
       // Delete forces depth first
@@ -565,6 +611,7 @@ void find_main(void)
       do_find);
 
   execdir(0, 1);
+  while (TT.running) exec_wait();
 
   if (CFG_TOYBOX_FREE) {
     close(TT.topdir);
@@ -8,7 +8,7 @@
  *
  * Posix doesn't even specify -r, documenting deviations from it is silly.
 
-USE_GREP(NEWTOY(grep, "S(exclude)*M(include)*C#B#A#ZzEFHabhinorsvwclqe*f*m#x[!wx][!EFw]", TOYFLAG_BIN))
+USE_GREP(NEWTOY(grep, "j#<1S(exclude)*M(include)*C#B#A#ZzEFHabhinorsvwclqe*f*m#x[!wx][!EF][!Ew]", TOYFLAG_BIN))
 USE_EGREP(OLDTOY(egrep, grep, TOYFLAG_BIN))
 USE_FGREP(OLDTOY(fgrep, grep, TOYFLAG_BIN))
 
@@ -16,7 +16,7 @@ config GREP
   bool "grep"
   default y
   help
-    usage: grep [-EFrivwcloqsHbhn] [-ABC NUM] [-m MAX] [-e REGEX]... [-MS PATTERN]... [-f REGFILE] [FILE]...
+    usage: grep [-EFrivwcloqsHbhn] [-ABC NUM] [-j N] [-m MAX] [-e REGEX]... [-MS PATTERN]... [-f REGFILE] [FILE]...
 
     Show lines matching regular expressions. If no -e, first argument is
     regular expression to match. With no files (or "-" filename) read stdin.
@@ -27,6 +27,7 @@ config GREP
 
     file search:
     -r  Recurse into subdirectories (defaults FILE to ".")
+    -j  Search N files at once with -r (output stays in order)
     -M  Match filename pattern (--include)
     -S  Skip filename pattern (--exclude)
 
@@ -71,51 +72,318 @@ GLOBALS(
   long c;
   struct arg_list *M;
   struct arg_list *S;
+  long j;
 
   char indelim, outdelim;
   int found;
+  struct grep_ac *ac, *candidate;
+
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t *threads;
+  struct grep_job *jobs, **jobtail, *pending;
+  int threadcount, queued, stop;
 )
 
+// A file queued for a -j worker. Output collects in a memory stream and is
+// written out once every file queued before it has been written.
+struct grep_job {
+  struct grep_job *next;
+  char *name, *out;
+  size_t len;
+  int fd, found, done;
+};
+
+// Aho-Corasick automaton to match all -F patterns in one pass over a line.
+// Node 0 is the root, whose transitions are a plain table. The rest live
+// in a hash keyed by node*256+char. Each node has a child/sibling list
+// for building fail links, and dict points to the nearest node down the
+// fail chain that ends a pattern.
+struct grep_ac {
+  int *fail, *dict, *len, *child, *sibling, *hval, root[256];
+  unsigned char *c;
+  unsigned *hkey, hmask;
+  int nodes, maxlen, empty, first;
+};
+
+static int ac_goto(struct grep_ac *ac, int node, int c)
+{
+  unsigned key = node*256+c, h;
+
+  if (!node) return ac->root[c];
+  for (h = key*2654435761U;; h++) {
+    h &= ac->hmask;
+    if (ac->hkey[h] == key) return ac->hval[h];
+    if (!ac->hkey[h]) return -1;
+  }
+}
+
+static void ac_set(struct grep_ac *ac, int node, int c, int next)
+{
+  unsigned key = node*256+c, h;
+
+  if (!node) ac->root[c] = next;
+  else {
+    for (h = key*2654435761U; ac->hkey[h &= ac->hmask]; h++);
+    ac->hkey[h] = key;
+    ac->hval[h] = next;
+  }
+}
+
+static int ac_fold(int c)
+{
+  return (toys.optflags & FLAG_i) ? tolower(c) : c;
+}
+
+static struct grep_ac *ac_build(struct arg_list *list)
+{
+  struct grep_ac *ac = xzalloc(sizeof(struct grep_ac));
+  struct arg_list *al;
+  long total = 1, i;
+  int *queue, head, tail;
+
+  for (al = list; al; al = al->next) total += strlen(al->arg);
+  ac->fail = xzalloc(6*total*sizeof(int));
+  ac->dict = ac->fail+total;
+  ac->len = ac->dict+total;
+  ac->child = ac->len+total;
+  ac->sibling = ac->child+total;
+  queue = ac->sibling+total;
+  ac->c = xzalloc(total);
+  for (ac->hmask = 1; ac->hmask<2*total; ac->hmask <<= 1);
+  ac->hkey = xzalloc(ac->hmask*sizeof(unsigned));
+  ac->hval = xmalloc(ac->hmask*sizeof(int));
+  ac->hmask--;
+  memset(ac->root, -1, sizeof(ac->root));
+  ac->nodes = 1;
+
+  // Build trie of patterns
+  for (al = list; al; al = al->next) {
+    unsigned char *ss = (void *)al->arg;
+    int node = 0, next;
+
+    for (; *ss; ss++) {
+      int c = ac_fold(*ss);
+
+      if (0>(next = ac_goto(ac, node, c))) {
+        next = ac->nodes++;
+        ac->c[next] = c;
+        ac->sibling[next] = ac->child[node];
+        ac->child[node] = next;
+        ac_set(ac, node, c, next);
+      }
+      node = next;
+    }
+    if ((i = strlen(al->arg))>ac->maxlen) ac->maxlen = i;
+    if (node) ac->len[node] = i;
+    else ac->empty++;
+  }
+
+  // Breadth first pass to fill out fail and dict links
+  for (head = 0, tail = 1; head<tail; head++) {
+    int node = queue[head], kid;
+
+    for (kid = ac->child[node]; kid; kid = ac->sibling[kid]) {
+      int f = ac->fail[node], next = -1;
+
+      queue[tail++] = kid;
+      if (node) {
+        for (;;) {
+          if (0<=(next = ac_goto(ac, f, ac->c[kid])) || !f) break;
+          f = ac->fail[f];
+        }
+      }
+      ac->fail[kid] = next<0 ? 0 : next;
+      f = ac->fail[kid];
+      ac->dict[kid] = ac->len[f] ? f : ac->dict[f];
+    }
+  }
+
+  // If all patterns start with the same byte (that case folding can't
+  // change), ac_match() can memchr() for it from the root.
+  ac->first = -1;
+  if ((i = ac->child[0]) && !ac->sibling[i]
+      && (!(toys.optflags & FLAG_i) || toupper(ac->c[i]) == ac->c[i]))
+    ac->first = ac->c[i];
+
+  return ac;
+}
+
+// Find leftmost longest match in first slen bytes of str, returns 0 if none.
+static int ac_match(struct grep_ac *ac, char *str, long slen, regmatch_t *m)
+{
+  unsigned char *ss = (void *)str;
+  long i, start = -1, len = 0;
+  int node = 0, next, n;
+
+  if (ac->empty) start = 0;
+  for (i = 0; i<slen; i++) {
+    int c = ac_fold(ss[i]);
+
+    // Later matches can't start before one we've already got.
+    if (start != -1 && i+1-ac->maxlen > start) break;
+    if (!node && ac->first != -1 && c != ac->first) {
+      unsigned char *x = memchr(ss+i, ac->first, slen-i);
+
+      if (!x) break;
+      c = *x;
+      i = x-ss;
+    }
+    while (0>(next = ac_goto(ac, node, c)) && node) node = ac->fail[node];
+    node = next<0 ? 0 : next;
+    for (n = ac->len[node] ? node : ac->dict[node]; n; n = ac->dict[n]) {
+      long st = i+1-ac->len[n];
+
+      if (start == -1 || st<start || (st == start && ac->len[n]>len)) {
+        start = st;
+        len = ac->len[n];
+      }
+    }
+  }
+  if (start == -1) return 0;
+  m->rm_so = start;
+  m->rm_eo = start+len;
+
+  return 1;
+}
+
+// Find a literal string every match of this regex has to contain, so we
+// can search for that first. Returns longest one outside of any group, or
+// 0 if there isn't one (or if there's alternation, which we don't analyze).
+static char *regex_literal(char *re)
+{
+  int ere = toys.optflags & FLAG_E, depth = 0, len = 0, best = 0, lit = 0;
+  char *run = xmalloc(strlen(re)+1), *found = xmalloc(strlen(re)+1), c;
+
+  for (;;) {
+    int quantifier = 0, special = 1;
+
+    if (!(c = *re++)) break;
+    if (c == '\\') {
+      if (!(c = *re++)) break;
+      if (ere ? !isalnum(c) : !!strchr(".[]*^$\\", c)) special = 0;
+      else if (!ere) {
+        if (c == '(') depth++;
+        else if (c == ')') depth--;
+        else if (c == '|') break;
+        else if (c == '{') {
+          // Skip to after \}, and give up if there isn't one.
+          while (*re && (*re != '\\' || re[1] != '}')) re++;
+          if (!*re) break;
+          re += 2;
+          quantifier++;
+        } else if (c == '?' || c == '+') quantifier++;
+      }
+    } else if (c == '[') {
+      if (*re == '^') re++;
+      if (*re == ']') re++;
+      while (*re && *re != ']') {
+        // [:class:] [=equiv=] and [.coll.] can contain ] of their own.
+        if (*re == '[' && re[1] && strchr(":=.", re[1])) {
+          char *end = re+2;
+
+          while (*end && (*end != re[1] || end[1] != ']')) end++;
+          if (*end) {
+            re = end+2;
+            continue;
+          }
+        }
+        re++;
+      }
+      if (*re) re++;
+    } else if (c == '*') quantifier++;
+    else if (ere && strchr("?+{", c)) {
+      if (c == '{') {
+        while (*re && *re != '}') re++;
+        if (!*re++) break;
+      }
+      quantifier++;
+    } else if (ere && c == '(') depth++;
+    else if (ere && c == ')') depth--;
+    else if (ere && c == '|') break;
+    else if (c != '.' && c != '^' && c != '$') special = 0;
+
+    // Quantifier makes previous char optional.
+    if (quantifier && lit && len) len--;
+    if (!special && !depth) {
+      run[len++] = c;
+      lit = 1;
+    } else {
+      if (len>best) memcpy(found, run, best = len);
+      len = lit = 0;
+    }
+  }
+  if (len>best) memcpy(found, run, best = len);
+  free(run);
+  if (c || !best) {
+    free(found);
+
+    return 0;
+  }
+  found[best] = 0;
+
+  return found;
+}
+
+// Advance to the next line that could match, counting the lines skipped.
+static void grep_skip(struct linebuf *lb, long *lcount, long *offset)
+{
+  regmatch_t m;
+  char *s, *e, *ss;
+  long len;
+  int found;
+
+  for (;;) {
+    s = linebuf_peek(lb, &len);
+    if ((found = ac_match(TT.candidate, s, len, &m))) len = m.rm_so;
+
+    // Discard complete lines before the candidate (or all complete lines).
+    for (e = s+len; e>s && e[-1] != TT.indelim; e--);
+    *offset += e-s;
+    if (toys.optflags & FLAG_n)
+      for (ss = s; (ss = memchr(ss, TT.indelim, e-ss)); ss++) ++*lcount;
+    linebuf_skip(lb, e-s);
+    if (found || !linebuf_fill(lb)) return;
+  }
+}
+
 // Emit line with various potential prefixes and delimiter
-static void outline(char *line, char dash, char *name, long lcount, long bcount,
-  int trim)
+static void outline(FILE *out, char *line, char dash, char *name, long lcount,
+  long bcount, int trim)
 {
-  if (name && (toys.optflags&FLAG_H)) printf("%s%c", name, dash);
+  if (name && (toys.optflags&FLAG_H)) fprintf(out, "%s%c", name, dash);
   if (!line || (lcount && (toys.optflags&FLAG_n)))
-    printf("%ld%c", lcount, line ? dash : TT.outdelim);
-  if (bcount && (toys.optflags&FLAG_b)) printf("%ld%c", bcount-1, dash);
-  if (line) xprintf("%.*s%c", trim, line, TT.outdelim);
+    fprintf(out, "%ld%c", lcount, line ? dash : TT.outdelim);
+  if (bcount && (toys.optflags&FLAG_b)) fprintf(out, "%ld%c", bcount-1, dash);
+  if (line) fprintf(out, "%.*s%c", trim, line, TT.outdelim);
+  if (out == stdout) xflush();
 }
 
-// Show matches in one file
-static void do_grep(int fd, char *name)
+// Show matches in one file, writing them to out. Returns whether any matched.
+static int grep_file(int fd, char *name, FILE *out)
 {
   struct double_list *dlb = 0;
-  FILE *file = fdopen(fd, "r");
+  struct linebuf *lb = linebuf_new(fd);
   long lcount = 0, mcount = 0, offset = 0, after = 0, before = 0;
   char *bars = 0;
+  int skip = TT.candidate && !(toys.optflags & FLAG_v) && !TT.a && !TT.b;
 
   if (!fd) name = "(standard input)";
 
-  if (!file) {
-    perror_msg("%s", name);
-
-    return;
-  }
-
   // Loop through lines of input
   for (;;) {
-    char *line = 0, *start;
+    char *line, *start;
     regmatch_t matches;
-    size_t unused;
     long len;
     int mmatch = 0;
 
+    // Lines that can't match aren't even split out of the buffer.
+    if (skip) grep_skip(lb, &lcount, &offset);
     lcount++;
     errno = 0;
-    len = getdelim(&line, &unused, TT.indelim, file);
+    line = linebuf_next(lb, &len, TT.indelim);
     if (errno) perror_msg("%s", name);
-    if (len<1) break;
+    if (!line) break;
     if (line[len-1] == TT.indelim) line[len-1] = 0;
 
     start = line;
@@ -126,28 +394,8 @@ static void do_grep(int fd, char *name)
 
       // Handle non-regex matches
       if (toys.optflags & FLAG_F) {
-        struct arg_list *seek, fseek;
-        char *s = 0;
-
-        for (seek = TT.e; seek; seek = seek->next) {
-          if (toys.optflags & FLAG_x) {
-            int i = (toys.optflags & FLAG_i);
-
-            if ((i ? strcasecmp : strcmp)(seek->arg, line)) s = line;
-          } else if (!*seek->arg) {
-            seek = &fseek;
-            fseek.arg = s = line;
-            break;
-          }
-          if (toys.optflags & FLAG_i) s = strnstr(line, seek->arg);
-          else s = strstr(line, seek->arg);
-          if (s) break;
-        }
-
-        if (s) {
-          matches.rm_so = (s-line);
-          skip = matches.rm_eo = (s-line)+strlen(seek->arg);
-        } else rc = 1;
+        rc = !ac_match(TT.ac, start, strlen(start), &matches);
+        skip = matches.rm_eo;
       } else {
         rc = regexec((regex_t *)toybuf, start, 1, &matches,
                      start==line ? 0 : REG_NOTBOL);
@@ -191,20 +439,18 @@ static void do_grep(int fd, char *name)
 
       // At least one line we didn't print since match while -ABC active
       if (bars) {
-        xputs(bars);
+        fprintf(out, "%s\n", bars);
         bars = 0;
       }
       mmatch++;
-      TT.found = 1;
-      if (toys.optflags & FLAG_q) {
-        toys.exitval = 0;
-        xexit();
-      }
-      if (toys.optflags & FLAG_l) {
-        xprintf("%s%c", name, TT.outdelim);
-        free(line);
-        fclose(file);
-        return;
+      if (toys.optflags & (FLAG_q|FLAG_l)) {
+        if (!(toys.optflags & FLAG_q)) {
+          fprintf(out, "%s%c", name, TT.outdelim);
+          if (out == stdout) xflush();
+        }
+        linebuf_free(lb);
+        close(fd);
+        return 1;
       }
       if (toys.optflags & FLAG_o)
         if (matches.rm_eo == matches.rm_so)
@@ -218,16 +464,16 @@ static void do_grep(int fd, char *name)
           while (dlb) {
             struct double_list *dl = dlist_pop(&dlb);
 
-            outline(dl->data, '-', name, lcount-before, 0, -1);
+            outline(out, dl->data, '-', name, lcount-before, 0, -1);
             free(dl->data);
             free(dl);
             before--;
           }
 
-          outline(line, ':', name, lcount, bcount, -1);
+          outline(out, line, ':', name, lcount, bcount, -1);
           if (TT.a) after = TT.a+1;
-        } else outline(start+matches.rm_so, ':', name, lcount, bcount,
-                       matches.rm_eo-matches.rm_so);
+        } else outline(out, start+matches.rm_so, ':', name, lcount,
+                       bcount, matches.rm_eo-matches.rm_so);
       }
 
       start += skip;
@@ -240,12 +486,11 @@ static void do_grep(int fd, char *name)
       int discard = (after || TT.b);
 
       if (after && --after) {
-        outline(line, '-', name, lcount, 0, -1);
+        outline(out, line, '-', name, lcount, 0, -1);
         discard = 0;
       }
       if (discard && TT.b) {
-        dlist_add(&dlb, line);
-        line = 0;
+        dlist_add(&dlb, xstrdup(line));
         if (++before>TT.b) {
           struct double_list *dl;
 
@@ -259,15 +504,100 @@ static void do_grep(int fd, char *name)
       // line (but don't show them now in case that was last match in file)
       if (discard && mcount) bars = "--";
     }
-    free(line);
 
     if ((toys.optflags & FLAG_m) && mcount >= TT.m) break;
   }
 
-  if (toys.optflags & FLAG_c) outline(0, ':', name, mcount, 0, -1);
+  if (toys.optflags & FLAG_c) outline(out, 0, ':', name, mcount, 0, -1);
+
+  linebuf_free(lb);
+  close(fd);
+
+  return !!mcount;
+}
+
+// Note a file's result. Only called from the main thread, in file order.
+static void grep_found(int found)
+{
+  if (!found) return;
+  TT.found = 1;
+  if (toys.optflags & FLAG_q) {
+    toys.exitval = 0;
+    xexit();
+  }
+}
+
+static void do_grep(int fd, char *name)
+{
+  grep_found(grep_file(fd, name, stdout));
+}
+
+// Worker thread for -j: grep queued files in order into their own buffers.
+static void *grep_thread(void *arg)
+{
+  struct grep_job *job;
+  FILE *out;
+
+  for (;;) {
+    pthread_mutex_lock(&TT.lock);
+    while (!(job = TT.pending) && !TT.stop) pthread_cond_wait(&TT.cond, &TT.lock);
+    if (job) TT.pending = job->next;
+    pthread_mutex_unlock(&TT.lock);
+    if (!job) return 0;
+
+    if (!(out = open_memstream(&job->out, &job->len))) perror_exit(0);
+    job->found = grep_file(job->fd, job->name, out);
+    if (fclose(out)) perror_exit(0);
+
+    pthread_mutex_lock(&TT.lock);
+    job->done = 1;
+    pthread_cond_broadcast(&TT.cond);
+    pthread_mutex_unlock(&TT.lock);
+  }
+}
+
+// Write out finished jobs from the head of the queue, waiting for unfinished
+// ones while more than "left" are outstanding. Called with TT.lock held.
+static void grep_emit(int left)
+{
+  struct grep_job *job;
+
+  while ((job = TT.jobs)) {
+    if (!job->done) {
+      if (TT.queued <= left) break;
+      pthread_cond_wait(&TT.cond, &TT.lock);
+      continue;
+    }
+    if (!(TT.jobs = job->next)) TT.jobtail = &TT.jobs;
+    TT.queued--;
+
+    pthread_mutex_unlock(&TT.lock);
+    xwrite(1, job->out, job->len);
+    free(job->out);
+    free(job->name);
+    grep_found(job->found);
+    free(job);
+    pthread_mutex_lock(&TT.lock);
+  }
+}
 
-  // loopfiles will also close the fd, but this frees an (opaque) struct.
-  fclose(file);
+// Hand a file to the -j workers. Takes ownership of name.
+static void grep_queue(int fd, char *name)
+{
+  struct grep_job *job = xzalloc(sizeof(struct grep_job));
+
+  job->fd = fd;
+  job->name = name;
+  pthread_mutex_lock(&TT.lock);
+  *TT.jobtail = job;
+  TT.jobtail = &job->next;
+  if (!TT.pending) TT.pending = job;
+  TT.queued++;
+  pthread_cond_broadcast(&TT.cond);
+
+  // Bound buffered output to a few files per worker.
+  grep_emit(4*TT.threadcount);
+  pthread_mutex_unlock(&TT.lock);
 }
 
 static void parse_regex(void)
@@ -303,7 +633,13 @@ static void parse_regex(void)
   }
   TT.e = list;
 
-  if (!(toys.optflags & FLAG_F)) {
+  // Literal strings every match has to contain (the -F patterns themselves
+  // or a chunk of each regex) let do_grep() search a whole buffer at once
+  // before splitting out lines.
+  if (toys.optflags & FLAG_F) {
+    TT.ac = ac_build(TT.e);
+    if (!TT.ac->empty) TT.candidate = TT.ac;
+  } else {
     char *regstr;
     int i;
 
@@ -328,6 +664,15 @@ static void parse_regex(void)
                sizeof(toybuf)-sizeof(regex_t));
       error_exit("bad REGEX: %s", toybuf);
     }
+
+    for (list = 0, al = TT.e; al; al = al->next) {
+      if (!(s = regex_literal(al->arg))) break;
+      new = xmalloc(sizeof(struct arg_list));
+      new->next = list;
+      new->arg = s;
+      list = new;
+    }
+    if (!al) TT.candidate = ac_build(list);
   }
 }
 
@@ -355,8 +700,12 @@ static int do_grep_r(struct dirtree *new)
   if (new->parent && !(toys.optflags & FLAG_h)) toys.optflags |= FLAG_H;
 
   name = dirtree_path(new, 0);
-  do_grep(openat(dirtree_parentfd(new), new->name, 0), name);
-  free(name);
+  if (TT.threadcount) grep_queue(openat(dirtree_parentfd(new), new->name, 0),
+    name);
+  else {
+    do_grep(openat(dirtree_parentfd(new), new->name, 0), name);
+    free(name);
+  }
 
   return 0;
 }
@@ -395,10 +744,32 @@ void grep_main(void)
   }
 
   if (toys.optflags & FLAG_r) {
+    // Start -j workers. If none start, just grep on this thread.
+    if (TT.j > 1) {
+      pthread_mutex_init(&TT.lock, 0);
+      pthread_cond_init(&TT.cond, 0);
+      TT.threads = xmalloc(TT.j*sizeof(pthread_t));
+      TT.jobtail = &TT.jobs;
+      for (; TT.threadcount < TT.j; TT.threadcount++)
+        if (pthread_create(TT.threads+TT.threadcount, 0, grep_thread, 0)) break;
+    }
+
     // Iterate through -r arguments. Use "." as default if none provided.
     for (ss = *ss ? ss : (char *[]){".", 0}; *ss; ss++) {
-      if (!strcmp(*ss, "-")) do_grep(0, *ss);
-      else dirtree_read(*ss, do_grep_r);
+      if (!strcmp(*ss, "-")) {
+        if (TT.threadcount) grep_queue(0, xstrdup(*ss));
+        else do_grep(0, *ss);
+      } else dirtree_read(*ss, do_grep_r);
+    }
+
+    if (TT.threadcount) {
+      pthread_mutex_lock(&TT.lock);
+      grep_emit(0);
+      TT.stop = 1;
+      pthread_cond_broadcast(&TT.cond);
+      pthread_mutex_unlock(&TT.lock);
+      while (TT.threadcount) pthread_join(TT.threads[--TT.threadcount], 0);
+      if (CFG_TOYBOX_FREE) free(TT.threads);
     }
   } else loopfiles_rw(ss, O_RDONLY|WARN_ONLY, 0, do_grep);
   toys.exitval = !TT.found;
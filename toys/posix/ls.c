@@ -320,8 +320,11 @@ static void listfiles(int dirfd, struct dirtree *indir)
     if (flags == (FLAG_1|FLAG_f)) return;
   // Read directory contents. We dup() the fd because this will close it.
   // This reads/saves contents to display later, except for in "ls -1f" mode.
+  // Skip stat() of non-directories when only names and types get shown.
   } else dirtree_recurse(indir, filter, dup(dirfd),
-      DIRTREE_SYMFOLLOW*!!(flags&FLAG_L));
+      DIRTREE_SYMFOLLOW*!!(flags&FLAG_L)|DIRTREE_STATLESS*!(flags&(FLAG_l
+        |FLAG_o|FLAG_n|FLAG_g|FLAG_s|FLAG_h|FLAG_i|FLAG_t|FLAG_S|FLAG_F
+        |FLAG_color)));
 
   // Copy linked list to array and sort it. Directories go in array because
   // we visit them in sorted order too. (The nested loops let us measure and
@@ -57,6 +57,7 @@ GLOBALS(
   long linenum;
   int context, state, filein, fileout, filepatch, hunknum;
   char *tempname;
+  struct linebuf *inbuf, *patchbuf;
 )
 
 // Dispose of a line of input, either by writing it out or discarding it.
@@ -87,7 +88,12 @@ static void do_line(void *data)
 
 static void finish_oldfile(void)
 {
-  if (TT.tempname) replace_tempfile(TT.filein, TT.fileout, &TT.tempname);
+  if (TT.tempname) {
+    linebuf_flush(TT.inbuf, TT.fileout);
+    replace_tempfile(TT.filein, TT.fileout, &TT.tempname);
+  }
+  linebuf_free(TT.inbuf);
+  TT.inbuf = 0;
   TT.fileout = TT.filein = -1;
 }
 
@@ -105,8 +111,10 @@ static void fail_hunk(void)
   TT.state = 2;
   llist_traverse(TT.current_hunk, do_line);
   TT.current_hunk = NULL;
-  if (!(toys.optflags & FLAG_dry_run))
+  if (!(toys.optflags & FLAG_dry_run)) {
+    if (TT.inbuf) linebuf_flush(TT.inbuf, -1);
     delete_tempfile(TT.filein, TT.fileout, &TT.tempname);
+  }
   TT.state = 0;
 }
 
@@ -158,7 +166,7 @@ static int apply_one_hunk(void)
   buf = NULL;
 
   for (;;) {
-    char *data = get_line(TT.filein);
+    char *data = TT.inbuf ? linebuf_line(TT.inbuf) : 0;
 
     TT.linenum++;
     // Figure out which line of hunk to compare with next.  (Skip lines
@@ -266,6 +274,7 @@ void patch_main(void)
   char *oldname = NULL, *newname = NULL;
 
   if (TT.infile) TT.filepatch = xopenro(TT.infile);
+  TT.patchbuf = linebuf_new(TT.filepatch);
   TT.filein = TT.fileout = -1;
 
   if (TT.dir) xchdir(TT.dir);
@@ -274,7 +283,7 @@ void patch_main(void)
   for (;;) {
     char *patchline;
 
-    patchline = get_line(TT.filepatch);
+    patchline = linebuf_line(TT.patchbuf);
     if (!patchline) break;
 
     // Other versions of patch accept damaged patches,
@@ -407,6 +416,7 @@ void patch_main(void)
           if (toys.optflags & FLAG_dry_run)
             TT.fileout = xopen("/dev/null", O_RDWR);
           else TT.fileout = copy_tempfile(TT.filein, name, &TT.tempname);
+          TT.inbuf = linebuf_new(TT.filein);
           TT.linenum = 0;
           TT.hunknum = 0;
         }
@@ -424,6 +434,7 @@ void patch_main(void)
   finish_oldfile();
 
   if (CFG_TOYBOX_FREE) {
+    linebuf_free(TT.patchbuf);
     close(TT.filepatch);
     free(oldname);
     free(newname);
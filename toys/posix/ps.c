@@ -276,7 +276,6 @@ GLOBALS(
 
   struct sysinfo si;
   struct ptr_len gg, GG, pp, PP, ss, tt, uu, UU;
-  struct dirtree *threadparent;
   unsigned width, height;
   dev_t tty;
   void *fields, *kfields;
@@ -284,6 +283,10 @@ GLOBALS(
   int kcount, forcek, sortpos;
   int (*match_process)(long long *slot);
   void (*show_process)(void *tb);
+
+  // top's per-task cache (see top_cache())
+  struct topcache **cache;
+  unsigned cachesize, cachecount, cachefds, cachemax, cachegen;
 )
 
 struct strawberry {
@@ -339,6 +342,28 @@ struct carveup {
   char str[];                 // name, tty, command, wchan, attr, cmdline
 };
 
+// Between top refreshes we keep each task's /proc files open (pread() from
+// the start re-generates them) and the strings that only change at exec.
+struct topcache {
+  struct topcache *next;
+  long long tid, starttime, ttynr, argv0len;
+  int fd[4];                  // stat, status, io, statm
+  unsigned gen;               // last /proc scan that saw this task
+  unsigned short len[5];
+  char *str[5], comm[16];     // tty, (wchan), label, exe, cmdline
+};
+
+// State for one /proc reader, hung off ->extra of the directory it's reading
+// (see scan_proc()) so several threads can read different pids at once.
+struct ps_scan {
+  struct dirtree *threadparent, *dir, **pids;
+  int (*callback)(struct dirtree *new);
+  char *buf;                  // toybuf-sized carveup scratch space
+  unsigned count, kcount;
+  pthread_t thread;
+  char running;
+};
+
 // TODO: Android uses -30 for LABEL, but ideally it would auto-size.
 // 64|slot means compare as string when sorting
 struct typography {
@@ -617,8 +642,109 @@ static void show_ps(void *p)
 }
 
 // dirtree callback: read data about process to display, store, or discard it.
-// Fills toybuf with struct carveup and either DIRTREE_SAVEs a copy to ->extra
-// (in -k mode) or calls show_ps on toybuf (no malloc/copy/free there).
+// Find or add the topcache entry for tid, marking it as seen this scan.
+static struct topcache *top_cache(long long tid)
+{
+  struct topcache **tc, *new, **old = TT.cache;
+  unsigned i, oldsize = TT.cachesize;
+
+  // Double the hash table when it fills up, so chains stay short.
+  if (TT.cachecount >= TT.cachesize) {
+    TT.cachesize = oldsize ? 2*oldsize : 1024;
+    TT.cache = xzalloc(TT.cachesize*sizeof(*TT.cache));
+    for (i = 0; i<oldsize; i++) while ((new = old[i])) {
+      old[i] = new->next;
+      tc = TT.cache+(new->tid&(TT.cachesize-1));
+      new->next = *tc;
+      *tc = new;
+    }
+    free(old);
+  }
+
+  for (tc = TT.cache+(tid&(TT.cachesize-1)); *tc; tc = &(*tc)->next)
+    if ((*tc)->tid == tid) break;
+  if (!(new = *tc)) {
+    *tc = new = xzalloc(sizeof(struct topcache));
+    new->tid = tid;
+    for (i = 0; i<ARRAY_LEN(new->fd); i++) new->fd[i] = -1;
+    TT.cachecount++;
+  }
+  new->gen = TT.cachegen;
+
+  return new;
+}
+
+// Forget cached strings (after exec), and open files too if fds.
+static void top_uncache(struct topcache *tc, int fds)
+{
+  int i;
+
+  for (i = 0; i<ARRAY_LEN(tc->str); i++) {
+    free(tc->str[i]);
+    tc->str[i] = 0;
+  }
+  if (fds) for (i = 0; i<ARRAY_LEN(tc->fd); i++) {
+    if (tc->fd[i] == -1) continue;
+    close(tc->fd[i]);
+    tc->fd[i] = -1;
+    TT.cachefds--;
+  }
+}
+
+// Free entries for tasks that weren't in the latest /proc scan.
+static void top_sweep(void)
+{
+  struct topcache **tc, *dead;
+  unsigned i;
+
+  for (i = 0; i<TT.cachesize; i++) {
+    for (tc = TT.cache+i; (dead = *tc);) {
+      if (dead->gen == TT.cachegen) tc = &dead->next;
+      else {
+        *tc = dead->next;
+        top_uncache(dead, 1);
+        free(dead);
+        TT.cachecount--;
+      }
+    }
+  }
+  TT.cachegen++;
+}
+
+// readfileat() for /proc/$PID files. If keep isn't NULL, leave the file open
+// there and pread() it next time. (If the task exited, so did the old fd.)
+static char *read_proc(int dirfd, char *name, char *buf, off_t *len, int *keep)
+{
+  int i;
+  ssize_t rlen;
+
+  for (i = 0; keep && i<2; i++) {
+    if (*keep == -1) {
+      if (TT.cachefds >= TT.cachemax) break;
+      if (-1 == (*keep = openat(dirfd, name, O_RDONLY|O_CLOEXEC))) break;
+      TT.cachefds++;
+    }
+    if (0<(rlen = pread(*keep, buf, *len-1, 0))) {
+      buf[*len = rlen] = 0;
+
+      return buf;
+    }
+    close(*keep);
+    *keep = -1;
+    TT.cachefds--;
+  }
+
+  return readfileat(dirfd, name, buf, len);
+}
+
+// Find the ps_scan for the directory this node is in.
+static struct ps_scan *get_scan(struct dirtree *new)
+{
+  return (void *)(new->parent ? new->parent : new)->extra;
+}
+
+// Fills scan->buf with struct carveup and either DIRTREE_SAVEs a copy to
+// ->extra (in -k mode) or calls show_ps on it (no malloc/copy/free there).
 static int get_ps(struct dirtree *new)
 {
   struct {
@@ -630,7 +756,10 @@ static int get_ps(struct dirtree *new)
     {"exe", _PS_COMMAND|_PS_COMM}, {"cmdline", _PS_CMDLINE|_PS_ARGS|_PS_NAME},
     {"", _PS_NAME}
   };
-  struct carveup *tb = (void *)toybuf;
+  struct ps_scan *scan = get_scan(new);
+  struct carveup *tb = (void *)scan->buf;
+  struct sysinfo si;
+  struct topcache *tc = 0;
   long long *slot = tb->slot;
   char *name, *s, *buf = tb->str, *end = 0;
   int i, j, fd;
@@ -639,17 +768,19 @@ static int get_ps(struct dirtree *new)
   // Recurse one level into /proc children, skip non-numeric entries
   if (!new->parent)
     return DIRTREE_RECURSE|DIRTREE_SHUTUP|DIRTREE_PROC
-      |(DIRTREE_SAVE*(TT.threadparent||!TT.show_process));
+      |(DIRTREE_SAVE*(scan->threadparent||!TT.show_process));
 
   memset(slot, 0, sizeof(tb->slot));
   tb->slot[SLOT_tid] = *slot = atol(new->name);
-  if (TT.threadparent && TT.threadparent->extra)
-    if (*slot == *(((struct carveup *)TT.threadparent->extra)->slot)) return 0;
+  if (scan->threadparent && scan->threadparent->extra)
+    if (*slot == *(((struct carveup *)scan->threadparent->extra)->slot))
+      return 0;
   fd = dirtree_parentfd(new);
+  if (TT.cachegen) tc = top_cache(*slot);
 
   len = 2048;
   sprintf(buf, "%lld/stat", *slot);
-  if (!readfileat(fd, buf, buf, &len)) return 0;
+  if (!read_proc(fd, buf, buf, &len, tc ? tc->fd : 0)) return 0;
 
   // parse oddball fields (name and state). Name can have embedded ')' so match
   // _last_ ')' in stat (although VFS limits filenames to 255 bytes max).
@@ -670,7 +801,16 @@ static int get_ps(struct dirtree *new)
       if (!TT.tty) tb->str[i] = '?';
   buf = tb->str+i;
   *buf++ = 0;
-  len = sizeof(toybuf)-(buf-toybuf);
+  len = sizeof(toybuf)-(buf-scan->buf);
+
+  // A new name or start time means exec or pid reuse: refetch strings.
+  if (tc && (tc->starttime != slot[SLOT_starttime]
+      || strncmp(tc->comm, tb->str, sizeof(tc->comm))))
+  {
+    top_uncache(tc, 0);
+    tc->starttime = slot[SLOT_starttime];
+    strncpy(tc->comm, tb->str, sizeof(tc->comm));
+  }
 
   // save uid, ruid, gid, gid, and rgid int slots 31-34 (we don't use sigcatch
   // or numeric wchan, and the remaining two are always zero), and vmlck into
@@ -690,7 +830,7 @@ static int get_ps(struct dirtree *new)
     off_t temp = len;
 
     sprintf(buf, "%lld/status", *slot);
-    if (!readfileat(fd, buf, buf, &temp)) *buf = 0;
+    if (!read_proc(fd, buf, buf, &temp, tc ? tc->fd+1 : 0)) *buf = 0;
     s = strafter(buf, "\nUid:");
     slot[SLOT_ruid] = s ? atol(s) : new->st.st_uid;
     s = strafter(buf, "\nGid:");
@@ -704,7 +844,7 @@ static int get_ps(struct dirtree *new)
     off_t temp = len;
 
     sprintf(buf, "%lld/io", *slot);
-    if (!readfileat(fd, buf, buf, &temp)) *buf = 0;
+    if (!read_proc(fd, buf, buf, &temp, tc ? tc->fd+2 : 0)) *buf = 0;
     if ((s = strafter(buf, "rchar:"))) slot[SLOT_rchar] = atoll(s);
     if ((s = strafter(buf, "wchar:"))) slot[SLOT_wchar] = atoll(s);
     if ((s = strafter(buf, "read_bytes:"))) slot[SLOT_rbytes] = atoll(s);
@@ -718,8 +858,8 @@ static int get_ps(struct dirtree *new)
 
   // /proc data is generated as it's read, so for maximum accuracy on slow
   // systems (or ps | more) we re-fetch uptime as we fetch each /proc line.
-  sysinfo(&TT.si);
-  slot[SLOT_uptime] = TT.si.uptime;
+  sysinfo(&si);
+  slot[SLOT_uptime] = si.uptime;
   slot[SLOT_upticks] = slot[SLOT_uptime]*TT.ticks - slot[SLOT_starttime];
 
   // Do we need to read "statm"?
@@ -727,7 +867,7 @@ static int get_ps(struct dirtree *new)
     off_t temp = len;
 
     sprintf(buf, "%lld/statm", *slot);
-    if (!readfileat(fd, buf, buf, &temp)) *buf = 0;
+    if (!read_proc(fd, buf, buf, &temp, tc ? tc->fd+3 : 0)) *buf = 0;
     
     for (s = buf, i=0; i<3; i++)
       if (!sscanf(s, " %lld%n", slot+SLOT_vsz+i, &j)) slot[SLOT_vsz+i] = 0;
@@ -760,9 +900,18 @@ static int get_ps(struct dirtree *new)
       continue;
     }
 
+    // Reuse top's copy of strings that don't change without exec.
+    if (tc && j<5 && tc->str[j] && (j || tc->ttynr == slot[SLOT_ttynr])) {
+      memcpy(buf, tc->str[j], (len = tc->len[j])+1);
+      if (j == 4) slot[SLOT_argv0len] = tc->argv0len;
+      buf += len+1;
+
+      continue;
+    }
+
     // Determine remaining space, reserving minimum of 256 bytes/field and
     // 260 bytes scratch space at the end (for output conversion later).
-    len = sizeof(toybuf)-(buf-toybuf)-260-256*(ARRAY_LEN(fetch)-j);
+    len = sizeof(toybuf)-(buf-scan->buf)-260-256*(ARRAY_LEN(fetch)-j);
     sprintf(buf, "%lld/%s", *slot, fetch[j].name);
 
     // For exe we readlink instead of read contents
@@ -771,8 +920,8 @@ static int get_ps(struct dirtree *new)
       int k;
 
       // Thread doesn't have exe or argv[0], so use parent's
-      if (TT.threadparent && TT.threadparent->extra)
-        ptb = (void *)TT.threadparent->extra;
+      if (scan->threadparent && scan->threadparent->extra)
+        ptb = (void *)scan->threadparent->extra;
 
       if (j==3 && !ptb) len = readlinkat0(fd, buf, buf, len);
       else {
@@ -866,27 +1015,35 @@ static int get_ps(struct dirtree *new)
       slot[SLOT_argv0len] = temp ? temp : len;  // Position of _first_ NUL
     }
 
+    // wchan changes, the rest is worth keeping for next time.
+    if (tc && j<5 && j!=1) {
+      free(tc->str[j]);
+      tc->str[j] = xmemdup(buf, len+1);
+      tc->len[j] = len;
+      if (!j) tc->ttynr = slot[SLOT_ttynr];
+      if (j == 4) tc->argv0len = slot[SLOT_argv0len];
+    }
+
     // Above calculated/retained len, so we don't need to re-strlen.
     buf += len+1;
   }
 
-  TT.kcount++;
-  if (TT.show_process && !TT.threadparent) {
+  scan->kcount++;
+  if (TT.show_process && !scan->threadparent) {
     TT.show_process(tb);
 
     return 0;
   }
 
   // If we need to sort the output, add it to the list and return.
-  s = xmalloc(buf-toybuf);
-  new->extra = (long)s;
-  memcpy(s, toybuf, buf-toybuf);
+  new->extra = (long)xmemdup(tb, buf-scan->buf);
 
   return DIRTREE_SAVE;
 }
 
 static int get_threads(struct dirtree *new)
 {
+  struct ps_scan *scan = get_scan(new);
   struct dirtree *dt;
   struct carveup *tb;
   unsigned pid, kcount;
@@ -894,21 +1051,24 @@ static int get_threads(struct dirtree *new)
   if (!new->parent) return get_ps(new);
   pid = atol(new->name);
 
-  TT.threadparent = new;
+  scan->threadparent = new;
   if (!get_ps(new)) {
-    TT.threadparent = 0;
+    scan->threadparent = 0;
 
     return 0;
   }
 
   // Recurse down into tasks, retaining thread groups.
   // Disable show_process at least until we can calculate tcount
-  kcount = TT.kcount;
-  sprintf(toybuf, "/proc/%u/task", pid);
-  new->child = dirtree_flagread(toybuf, DIRTREE_SHUTUP|DIRTREE_PROC, get_ps);
+  kcount = scan->kcount;
+  sprintf(scan->buf, "/proc/%u/task", pid);
+  if ((dt = dirtree_add_node(0, scan->buf, DIRTREE_SHUTUP)))
+    dt->extra = (long)scan;
+  new->child = dirtree_handle_callback(dt, get_ps);
   if (new->child == DIRTREE_ABORTVAL) new->child = 0;
-  TT.threadparent = 0;
-  kcount = TT.kcount-kcount+1;
+  else if (new->child) new->child->extra = 0;
+  scan->threadparent = 0;
+  kcount = scan->kcount-kcount+1;
   tb = (void *)new->extra;
   tb->slot[SLOT_tcount] = kcount;
 
@@ -936,6 +1096,127 @@ static int get_threads(struct dirtree *new)
   return 0;
 }
 
+// dirtree callback: list /proc/$PID without reading anything yet.
+static int save_pid(struct dirtree *new)
+{
+  if (new->parent) return DIRTREE_SAVE;
+
+  return DIRTREE_SAVE|DIRTREE_RECURSE|DIRTREE_SHUTUP|DIRTREE_PROC;
+}
+
+// Read a shard of the pid list, freeing the ones callback didn't keep.
+static void *scan_thread(void *arg)
+{
+  struct ps_scan *scan = arg;
+  unsigned i;
+
+  for (i = 0; i<scan->count; i++) {
+    scan->pids[i]->parent = scan->dir;
+    if (!(scan->callback(scan->pids[i])&DIRTREE_SAVE)) {
+      free(scan->pids[i]);
+      scan->pids[i] = 0;
+    }
+  }
+
+  return 0;
+}
+
+// Call callback on each /proc/$PID, returning the tree of DIRTREE_SAVEd nodes
+// (or DIRTREE_ABORTVAL). With lots of processes and more than one CPU, list
+// the pids first and split the reads between threads, then show or return
+// the results in the same order a single pass would have.
+static struct dirtree *scan_proc(int (*callback)(struct dirtree *new))
+{
+  struct ps_scan *scan, one;
+  struct dirtree *dt, *new, **pids, **tail;
+  void (*show)(void *tb) = TT.show_process;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  unsigned count, threads, i;
+
+  // top's cache isn't threadsafe, and it mostly re-reads open files anyway.
+  if (cpus<2 || TT.cachegen) {
+    memset(&one, 0, sizeof(one));
+    one.buf = toybuf;
+    if ((dt = dirtree_add_node(0, "/proc", DIRTREE_SHUTUP)))
+      dt->extra = (long)&one;
+    dt = dirtree_handle_callback(dt, callback);
+    if (dt && dt != DIRTREE_ABORTVAL) dt->extra = 0;
+    TT.kcount += one.kcount;
+
+    return dt;
+  }
+
+  dt = dirtree_flagread("/proc", DIRTREE_SHUTUP, save_pid);
+  if (dt == DIRTREE_ABORTVAL) return dt;
+  for (count = 0, new = dt->child; new; new = new->next) count++;
+  pids = xmalloc(count*sizeof(*pids));
+  for (i = 0, new = dt->child; new; new = new->next) pids[i++] = new;
+  dt->child = 0;
+  dt->dirfd = open("/proc", O_RDONLY|O_CLOEXEC);
+
+  // At least 256 pids per thread, else thread startup costs more than it saves
+  threads = count/256;
+  if (threads>cpus) threads = cpus;
+  if (!threads) threads = 1;
+  scan = xzalloc(threads*sizeof(*scan));
+
+  // Everything gets saved and shown at the end, in readdir order.
+  TT.show_process = 0;
+  for (i = threads; i--;) {
+    scan[i].dir = xzalloc(sizeof(struct dirtree)+6);
+    strcpy(scan[i].dir->name, "/proc");
+    scan[i].dir->dirfd = dt->dirfd;
+    scan[i].dir->extra = (long)(scan+i);
+    scan[i].pids = pids+i*count/threads;
+    scan[i].count = (i+1)*count/threads-i*count/threads;
+    scan[i].callback = callback;
+    scan[i].buf = i ? xmalloc(sizeof(toybuf)) : toybuf;
+
+    // The main thread does shard 0, and any shard a thread can't start for.
+    if (i && !pthread_create(&scan[i].thread, 0, scan_thread, scan+i))
+      scan[i].running++;
+    else scan_thread(scan+i);
+  }
+  for (i = 0; i<threads; i++) {
+    if (scan[i].running) pthread_join(scan[i].thread, 0);
+    TT.kcount += scan[i].kcount;
+    if (i) free(scan[i].buf);
+    free(scan[i].dir);
+  }
+  free(scan);
+  close(dt->dirfd);
+  dt->dirfd = -1;
+  TT.show_process = show;
+
+  // Relink the survivors under /proc, or display and free them.
+  tail = &dt->child;
+  for (i = 0; i<count; i++) if ((new = pids[i])) {
+    new->parent = dt;
+    new->next = 0;
+    if (show) {
+      struct dirtree *kid = new->child ? new->child->child : 0;
+
+      show((void *)new->extra);
+      free((void *)new->extra);
+      while (kid) {
+        show((void *)kid->extra);
+        free((void *)kid->extra);
+        free(llist_pop(&kid));
+      }
+      free(new->child);
+      free(new);
+    } else {
+      *tail = new;
+      tail = &new->next;
+    }
+  }
+  free(pids);
+  if (!show) return dt;
+  free(dt);
+
+  return 0;
+}
+
 static char *parse_ko(void *data, char *type, int length)
 {
   struct strawberry *field;
@@ -1156,6 +1437,7 @@ static void shared_main(void)
   int i;
 
   TT.ticks = sysconf(_SC_CLK_TCK);
+  sysinfo(&TT.si);
   if (!TT.width) {
     TT.width = 80;
     TT.height = 25;
@@ -1246,9 +1528,8 @@ void ps_main(void)
   if (!(toys.optflags&FLAG_M)) printf("%.*s\n", TT.width, toybuf);
   if (!(toys.optflags&(FLAG_k|FLAG_M))) TT.show_process = show_ps;
   TT.match_process = ps_match_process;
-  dt = dirtree_flagread("/proc", DIRTREE_SHUTUP|DIRTREE_PROC,
-    ((toys.optflags&FLAG_T) || (TT.bits&(_PS_TID|_PS_TCNT)))
-      ? get_threads : get_ps);
+  dt = scan_proc(((toys.optflags&FLAG_T) || (TT.bits&(_PS_TID|_PS_TCNT)))
+    ? get_threads : get_ps);
 
   if ((dt != DIRTREE_ABORTVAL) && toys.optflags&(FLAG_k|FLAG_M)) {
     struct carveup **tbsort = collate(TT.kcount, dt);
@@ -1363,9 +1644,20 @@ static void top_common(
  
   unsigned tock = 0;
   int i, lines, topoff = 0, done = 0;
+  struct rlimit rl;
 
   toys.signal = SIGWINCH;
   TT.bits = get_headers(TT.fields, toybuf, sizeof(toybuf));
+
+  // Cache /proc data between refreshes. Keep files open up to the hard
+  // limit, with some fds left over for everything else.
+  TT.cachegen = 1;
+  if (!getrlimit(RLIMIT_NOFILE, &rl)) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    getrlimit(RLIMIT_NOFILE, &rl);
+    if (rl.rlim_cur > 64) TT.cachemax = rl.rlim_cur-64;
+  }
   *scratch = 0;
   memset(plist, 0, sizeof(plist));
   memset(stats, 0, sizeof(stats));
@@ -1376,12 +1668,12 @@ static void top_common(
     plold = plist+(tock++&1);
     plnew = plist+(tock&1);
     plnew->whence = millitime();
-    dt = dirtree_flagread("/proc", DIRTREE_SHUTUP|DIRTREE_PROC,
-      ((toys.optflags&FLAG_H) || (TT.bits&(_PS_TID|_PS_TCNT)))
-        ? get_threads : get_ps);
+    dt = scan_proc(((toys.optflags&FLAG_H) || (TT.bits&(_PS_TID|_PS_TCNT)))
+      ? get_threads : get_ps);
     if (dt == DIRTREE_ABORTVAL) error_exit("no /proc");
     plnew->tb = collate(plnew->count = TT.kcount, dt);
     TT.kcount = 0;
+    top_sweep();
 
     if (readfile("/proc/stat", pos = toybuf, sizeof(toybuf))) {
       long long *st = stats+8*(tock&1);
@@ -1556,7 +1848,7 @@ static void top_common(
         msleep(timeout-now);
         // Make an obvious gap between datasets.
         xputs("\n\n");
-        continue;
+        break;
       }
 
       i = scan_key_getsize(scratch, timeout-now, &TT.width, &TT.height);
@@ -1734,7 +2026,7 @@ static void match_pgrep(void *p)
     if (TT.time && TT.time>ll) return;
     TT.time = ll;
     free(TT.pgrep.snapshot);
-    TT.pgrep.snapshot = xmemdup(toybuf, (name+strlen(name)+1)-toybuf);
+    TT.pgrep.snapshot = xmemdup(tb, (name+strlen(name)+1)-(char *)tb);
   } else do_pgk(tb);
 }
 
@@ -1781,7 +2073,7 @@ void pgrep_main(void)
   // pgrep should return failure if there are no matches.
   toys.exitval = 1;
 
-  dirtree_flagread("/proc", DIRTREE_SHUTUP|DIRTREE_PROC, get_ps);
+  scan_proc(get_ps);
   if (toys.optflags&FLAG_c) printf("%d\n", TT.sortpos);
   if (TT.pgrep.snapshot) {
     do_pgk(TT.pgrep.snapshot);
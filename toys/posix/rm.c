@@ -54,7 +54,7 @@ static int do_rm(struct dirtree *try)
       if (toys.optflags & FLAG_f) wfchmodat(fd, try->name, 0700);
       else goto skip;
     }
-    if (!try->again) return DIRTREE_COMEAGAIN;
+    if (!try->again) return DIRTREE_COMEAGAIN|DIRTREE_STATLESS;
     if (try->symlink) goto skip;
     if (flags & FLAG_i) {
       char *s = dirtree_path(try, 0);
@@ -99,6 +99,8 @@ void rm_main(void)
     // dirtree's stat would report the nonexistence as an error, but that's
     // not a normal "it didn't exist" so I'm ok with it.
 
-    dirtree_read(*s, do_rm);
+    // Without prompts, delete different directories' contents in parallel.
+    dirtree_flagread(*s, DIRTREE_PARALLEL*!((toys.optflags&FLAG_i)
+      || (!(toys.optflags&FLAG_f) && isatty(0))), do_rm);
   }
 }
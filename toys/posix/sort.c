@@ -7,7 +7,7 @@
  * Deviations from POSIX: Lots.
  * We invented -x
 
-USE_SORT(NEWTOY(sort, USE_SORT_FLOAT("g")USE_SORT_BIG("S:T:m" "o:k*t:xbMcszdfi") "run", TOYFLAG_USR|TOYFLAG_BIN))
+USE_SORT(NEWTOY(sort, USE_SORT_BIG("(parallel)#<1")USE_SORT_FLOAT("g")USE_SORT_BIG("S:T:m" "o:k*t:xbMcszdfi") "run", TOYFLAG_USR|TOYFLAG_BIN))
 
 config SORT
   bool "sort"
@@ -26,7 +26,7 @@ config SORT_BIG
   default y
   depends on SORT
   help
-    usage: sort [-bcdfiMsz] [-k#[,#[x]] [-t X]] [-o FILE]
+    usage: sort [-bcdfiMsz] [-k#[,#[x]] [-t X]] [-o FILE] [-S SIZE] [-T DIR] [--parallel=N]
 
     -b	ignore leading blanks (or trailing blanks in second part of key)
     -c	check whether input is sorted
@@ -40,6 +40,9 @@ config SORT_BIG
     -k	sort by "key" (see below)
     -t	use a key separator other than whitespace
     -o	output to FILE instead of stdout
+    -S	use SIZE memory (default unit k, or % of RAM), spill the rest to disk
+    -T	directory for -S temporary files (default $TMPDIR or /tmp)
+    --parallel	sort using N threads
 
     Sorting by key looks at a subset of the words on each line.  -k2
     uses the second word to the end of the line, -k2,2 looks at only
@@ -65,11 +68,15 @@ GLOBALS(
   char *key_separator;
   struct arg_list *raw_keys;
   char *outfile;
-  char *ignore1, ignore2;   // GNU compatability NOPs for -S and -T.
+  char *tmpdir, *bufsize;
+  long parallel;
 
   void *key_list;
-  int linecount;
+  int linecount, runcount, keycount;
+  int (*compare)(const void *xarg, const void *yarg);
   char **lines;
+  long long buffer, used;
+  struct sort_run *runs;
 )
 
 // The sort types are n, g, and M.
@@ -86,6 +93,36 @@ struct sort_key
   int flags;
 };
 
+// A sorted run: a temp file written by -S (or the in-memory lines if !fp)
+struct sort_run
+{
+  FILE *fp;
+  char *line;
+  size_t size;
+  long idx;
+};
+
+// Decorate-sort-undecorate: while sorting, TT.lines points to one of these
+// per line, with each key chopped out (and numbers parsed) once up front.
+struct sort_cache
+{
+  char *str;     // key text (for ascii sorts)
+  int cat;       // -g: not a number < NaN < number, -M: non-month < month
+  union {
+    double d;
+    long long ll;
+  } val;
+};
+
+struct sort_rec
+{
+  char *line;
+  struct sort_cache key[];
+};
+
+// Merge this many runs into one before opening another temp file.
+#define SORT_MAXRUNS 128
+
 // Copy of the part of this string corresponding to a key/flags.
 
 static char *get_key_data(char *str, struct sort_key *key, int flags)
@@ -272,14 +309,424 @@ static int compare_keys(const void *xarg, const void *yarg)
   return retval * ((flags&FLAG_r) ? -1 : 1);
 }
 
+// Parse one key of a line into the cache, same rules as compare_values().
+static void cache_key(struct sort_cache *c, char *line, struct sort_key *key,
+  int flags)
+{
+  int ff = flags & (FLAG_n|FLAG_g|FLAG_M|FLAG_x);
+  char *x = get_key_data(line, key, flags), *xx;
+
+  c->str = x;
+  c->cat = 0;
+  if (!ff) return;
+  if (CFG_SORT_FLOAT && ff == FLAG_g) {
+    c->val.d = strtod(x, &xx);
+    if (x != xx) c->cat = (c->val.d != c->val.d) ? 1 : 2;
+    if (c->cat != 2) c->val.d = 0;
+  } else if (CFG_SORT_BIG && ff == FLAG_M) {
+    struct tm thyme;
+
+    if (strptime(x, "%b", &thyme)) {
+      c->cat = 1;
+      c->val.ll = thyme.tm_mon;
+    } else c->val.ll = 0;
+  } else if (CFG_SORT_BIG && ff == FLAG_x) c->val.ll = strtol(x, NULL, 16);
+  else if (CFG_SORT_FLOAT) c->val.d = atof(x);
+  else c->val.ll = atoi(x);
+  if (x != line) free(x);
+  c->str = 0;
+}
+
+static int compare_cache(int flags, struct sort_cache *x, struct sort_cache *y)
+{
+  int ff = flags & (FLAG_n|FLAG_g|FLAG_M|FLAG_x);
+
+  if (!ff) return ((flags&FLAG_f) ? strcasecmp : strcmp)(x->str, y->str);
+  if (x->cat != y->cat) return x->cat<y->cat ? -1 : 1;
+  if (CFG_SORT_FLOAT && (ff == FLAG_g || (ff != FLAG_M && ff != FLAG_x)))
+    return (x->val.d>y->val.d)-(x->val.d<y->val.d);
+
+  return (x->val.ll>y->val.ll)-(x->val.ll<y->val.ll);
+}
+
+// compare_keys() for decorated lines
+static int compare_cached(const void *xarg, const void *yarg)
+{
+  struct sort_rec *xx = *(struct sort_rec **)xarg,
+    *yy = *(struct sort_rec **)yarg;
+  struct sort_key *key;
+  int flags = toys.optflags, retval = 0, i;
+
+  for (key = TT.key_list, i = 0; key; key = key->next_key, i++) {
+    flags = key->flags ? key->flags : toys.optflags;
+    if ((retval = compare_cache(flags, xx->key+i, yy->key+i))) break;
+  }
+  if (!retval && !(toys.optflags&FLAG_s)) {
+    flags = toys.optflags;
+    retval = strcmp(xx->line, yy->line);
+  }
+
+  return retval * ((flags&FLAG_r) ? -1 : 1);
+}
+
+// Replace each of TT.lines with a sort_rec holding its cached keys.
+static void *decorate_lines(void)
+{
+  long size = sizeof(struct sort_rec)+TT.keycount*sizeof(struct sort_cache);
+  char *recs = xmalloc(TT.linecount*size);
+  struct sort_key *key;
+  int idx, i;
+
+  for (idx = 0; idx<TT.linecount; idx++) {
+    struct sort_rec *rec = (void *)(recs+idx*size);
+
+    rec->line = TT.lines[idx];
+    for (key = TT.key_list, i = 0; key; key = key->next_key, i++)
+      cache_key(rec->key+i, rec->line, key,
+        key->flags ? key->flags : toys.optflags);
+    TT.lines[idx] = (void *)rec;
+  }
+
+  return recs;
+}
+
+// Free a sort_rec's key copies and return its line.
+static char *undecorate(void *arg)
+{
+  struct sort_rec *rec = arg;
+  int i;
+
+  for (i = 0; i<TT.keycount; i++)
+    if (rec->key[i].str != rec->line) free(rec->key[i].str);
+
+  return rec->line;
+}
+
+// --parallel: each thread merge sorts a chunk of the lines, then pairs of
+// adjacent chunks are merged (splitting each merge between threads) until
+// one is left. Merges are stable, so equal lines keep input order for -s.
+
+struct sort_job {
+  char **a, **b, **out;
+  long alen, blen, start, end;
+};
+
+// Merge sorted a and b into out, taking from a first for equal lines.
+static void merge_lines(char **out, char **a, long alen, char **b, long blen)
+{
+  while (alen && blen) {
+    if (TT.compare(b, a)<0) *out++ = *b++, blen--;
+    else *out++ = *a++, alen--;
+  }
+  memcpy(out, a, alen*sizeof(char *));
+  memcpy(out+alen, b, blen*sizeof(char *));
+}
+
+// Stable merge sort with scratch space tmp (same size as lines).
+static void merge_sort(char **lines, char **tmp, long len)
+{
+  long i, j, half = len/2;
+
+  // Insertion sort small ranges.
+  if (len<16) {
+    for (i = 1; i<len; i++) {
+      char *s = lines[i];
+
+      for (j = i; j && TT.compare(lines+j-1, &s)>0; j--)
+        lines[j] = lines[j-1];
+      lines[j] = s;
+    }
+
+    return;
+  }
+  merge_sort(lines, tmp, half);
+  merge_sort(lines+half, tmp+half, len-half);
+  merge_lines(tmp, lines, half, lines+half, len-half);
+  memcpy(lines, tmp, len*sizeof(char *));
+}
+
+// How many of the first k merged lines come from a.
+static long merge_split(struct sort_job *job, long k)
+{
+  long lo = maxof(0, k-job->blen), hi = minof(k, job->alen), mid;
+
+  while (lo<hi) {
+    mid = (lo+hi)/2;
+    if (TT.compare(job->b+k-mid-1, job->a+mid)<0) hi = mid;
+    else lo = mid+1;
+  }
+
+  return lo;
+}
+
+static void *sort_thread(void *arg)
+{
+  struct sort_job *job = arg;
+
+  merge_sort(job->a, job->out, job->alen);
+
+  return 0;
+}
+
+// Produce lines start to end of the merge of a and b.
+static void *merge_thread(void *arg)
+{
+  struct sort_job *job = arg;
+  long i = merge_split(job, job->start), j = merge_split(job, job->end);
+
+  merge_lines(job->out+job->start, job->a+i, j-i, job->b+job->start-i,
+    job->end-j-job->start+i);
+
+  return 0;
+}
+
+// Run count jobs, all but the first on new threads.
+static void run_jobs(void *(*fn)(void *), struct sort_job *jobs, int count)
+{
+  pthread_t *tid = xmalloc(count*sizeof(pthread_t));
+  char *started = xzalloc(count);
+  int i;
+
+  for (i = 1; i<count; i++)
+    if (!(started[i] = !pthread_create(tid+i, 0, fn, jobs+i))) fn(jobs+i);
+  fn(jobs);
+  for (i = 1; i<count; i++) if (started[i]) pthread_join(tid[i], 0);
+  free(started);
+  free(tid);
+}
+
+static void sort_parallel(int chunks)
+{
+  struct sort_job *jobs = xzalloc(TT.parallel*sizeof(struct sort_job));
+  long *bound = xmalloc((chunks+1)*sizeof(long)), i, j, per;
+  char **from = TT.lines, **to = xmalloc(TT.linecount*sizeof(char *)), **swap;
+
+  for (i = 0; i<=chunks; i++) bound[i] = TT.linecount*i/chunks;
+  for (i = 0; i<chunks; i++) {
+    jobs[i].a = from+bound[i];
+    jobs[i].out = to+bound[i];
+    jobs[i].alen = bound[i+1]-bound[i];
+  }
+  run_jobs(sort_thread, jobs, chunks);
+
+  while (chunks>1) {
+    int njobs = 0, pairs = chunks/2;
+
+    per = maxof(1, TT.parallel/pairs);
+    for (i = 0; i<pairs; i++) {
+      struct sort_job job;
+
+      job.a = from+bound[2*i];
+      job.alen = bound[2*i+1]-bound[2*i];
+      job.b = from+bound[2*i+1];
+      job.blen = bound[2*i+2]-bound[2*i+1];
+      job.out = to+bound[2*i];
+      for (j = 0; j<per; j++) {
+        job.start = (job.alen+job.blen)*j/per;
+        job.end = (job.alen+job.blen)*(j+1)/per;
+        jobs[njobs++] = job;
+      }
+    }
+    if (chunks&1) memcpy(to+bound[chunks-1], from+bound[chunks-1],
+      (bound[chunks]-bound[chunks-1])*sizeof(char *));
+    run_jobs(merge_thread, jobs, njobs);
+
+    for (i = 0; i<=pairs; i++) bound[i] = bound[2*i];
+    bound[chunks = (chunks+1)/2] = TT.linecount;
+    swap = from;
+    from = to;
+    to = swap;
+  }
+  if (from != TT.lines) {
+    memcpy(TT.lines, from, TT.linecount*sizeof(char *));
+    to = from;
+  }
+  free(to);
+  free(bound);
+  free(jobs);
+}
+
+// Sort TT.lines and handle -u
+static void sort_lines(void)
+{
+  void *recs = 0;
+  int idx, jdx;
+
+  TT.compare = compare_keys;
+  if (CFG_SORT_BIG && TT.keycount) {
+    recs = decorate_lines();
+    TT.compare = compare_cached;
+  }
+
+  // Don't bother with threads for less than a few thousand lines each.
+  idx = minof(TT.parallel, TT.linecount/4096);
+  if (CFG_SORT_BIG && idx>1) sort_parallel(idx);
+  else qsort(TT.lines, TT.linecount, sizeof(char *), TT.compare);
+
+  if (toys.optflags&FLAG_u) {
+    for (jdx=0, idx=1; idx<TT.linecount; idx++) {
+      if (!TT.compare(&TT.lines[jdx], &TT.lines[idx])) {
+        if (recs) TT.lines[idx] = undecorate(TT.lines[idx]);
+        free(TT.lines[idx]);
+      } else TT.lines[++jdx] = TT.lines[idx];
+    }
+    if (TT.linecount) TT.linecount = jdx+1;
+  }
+  if (recs) {
+    for (idx = 0; idx<TT.linecount; idx++)
+      TT.lines[idx] = undecorate(TT.lines[idx]);
+    free(recs);
+  }
+}
+
+static void sort_put(FILE *fp, char *s)
+{
+  if (toys.optflags&FLAG_z) fwrite(s, strlen(s)+1, 1, fp);
+  else {
+    fputs(s, fp);
+    putc('\n', fp);
+  }
+}
+
+// Read next line of a run into run->line, returns 0 at end of run.
+static int sort_next(struct sort_run *run)
+{
+  ssize_t len;
+
+  if (!run->fp) {
+    if (run->idx == TT.linecount) return 0;
+    run->line = TT.lines[run->idx++];
+
+    return 1;
+  }
+  len = getdelim(&run->line, &run->size, (toys.optflags&FLAG_z) ? 0 : '\n',
+    run->fp);
+  if (len<1) return 0;
+  if (run->line[len-1]=='\n') run->line[len-1] = 0;
+
+  return 1;
+}
+
+// Order runs by current line, earlier run first for equal lines so -s
+// stays stable.
+static int run_cmp(struct sort_run *a, struct sort_run *b)
+{
+  int i = compare_keys(&a->line, &b->line);
+
+  return i ? i : (a>b)-(a<b);
+}
+
+// Restore heap property moving down from position i
+static void heap_down(struct sort_run **heap, int len, int i)
+{
+  for (;;) {
+    int j = 2*i+1;
+    struct sort_run *swap;
+
+    if (j>=len) break;
+    if (j+1<len && run_cmp(heap[j+1], heap[j])<0) j++;
+    if (run_cmp(heap[i], heap[j])<=0) break;
+    swap = heap[i];
+    heap[i] = heap[j];
+    heap[j] = swap;
+    i = j;
+  }
+}
+
+// K-way merge of count runs to fp, closing the temp files.
+static void sort_merge(struct sort_run *runs, int count, FILE *fp)
+{
+  struct sort_run **heap = xmalloc(count*sizeof(struct sort_run *));
+  char *last = 0;
+  size_t lastsize = 0;
+  int i, len = 0, have = 0;
+
+  for (i = 0; i<count; i++) {
+    if (runs[i].fp) rewind(runs[i].fp);
+    if (sort_next(runs+i)) heap[len++] = runs+i;
+  }
+  for (i = len/2; i>=0; i--) heap_down(heap, len, i);
+
+  while (len) {
+    struct sort_run *run = *heap;
+
+    if (!have || !(toys.optflags&FLAG_u) || compare_keys(&last, &run->line)) {
+      sort_put(fp, run->line);
+      if (toys.optflags&FLAG_u) {
+        size_t l = strlen(run->line)+1;
+
+        if (l>lastsize) last = xrealloc(last, lastsize = l);
+        memcpy(last, run->line, l);
+        have++;
+      }
+    }
+    if (!run->fp) free(run->line);
+    if (!sort_next(run)) *heap = heap[--len];
+    heap_down(heap, len, 0);
+  }
+
+  for (i = 0; i<count; i++) {
+    if (!runs[i].fp) continue;
+    fclose(runs[i].fp);
+    free(runs[i].line);
+  }
+  free(heap);
+  free(last);
+}
+
+// Open a new (already deleted) temp file for a run under -T.
+static FILE *sort_tempfile(void)
+{
+  char *name = xmprintf("%s/sortXXXXXX", TT.tmpdir);
+  int fd = mkstemp(name);
+
+  if (fd == -1) perror_exit("mkstemp %s", name);
+  unlink(name);
+  free(name);
+
+  return xfdopen(fd, "w+");
+}
+
+// Sort the lines read so far and write them out as a new run.
+static void sort_spill(void)
+{
+  struct sort_run *run;
+  int idx;
+
+  if (!(TT.runcount&63))
+    TT.runs = xrealloc(TT.runs, sizeof(struct sort_run)*(TT.runcount+64));
+  run = memset(TT.runs+TT.runcount++, 0, sizeof(struct sort_run));
+  run->fp = sort_tempfile();
+  sort_lines();
+  for (idx = 0; idx<TT.linecount; idx++) {
+    sort_put(run->fp, TT.lines[idx]);
+    free(TT.lines[idx]);
+  }
+  if (fflush(run->fp) || ferror(run->fp)) perror_exit("write");
+  TT.linecount = TT.used = 0;
+
+  // Bound the number of open temp files by merging them into one.
+  if (TT.runcount == SORT_MAXRUNS) {
+    FILE *fp = sort_tempfile();
+
+    sort_merge(TT.runs, TT.runcount, fp);
+    if (fflush(fp) || ferror(fp)) perror_exit("write");
+    memset(TT.runs, 0, sizeof(struct sort_run));
+    TT.runs->fp = fp;
+    TT.runcount = 1;
+  }
+}
+
 // Callback from loopfiles to handle input files.
 static void sort_read(int fd, char *name)
 {
+  struct linebuf *lb = linebuf_new(fd);
+
   // Read each line from file, appending to a big array.
 
   for (;;) {
     char * line = (CFG_SORT_BIG && (toys.optflags&FLAG_z))
-             ? get_rawline(fd, NULL, 0) : get_line(fd);
+             ? linebuf_rawline(lb, NULL, 0) : linebuf_line(lb);
 
     if (!line) break;
 
@@ -295,14 +742,42 @@ static void sort_read(int fd, char *name)
       if (!(TT.linecount&63))
         TT.lines = xrealloc(TT.lines, sizeof(char *)*(TT.linecount+64));
       TT.lines[TT.linecount] = line;
+      if (TT.buffer
+        && (TT.used += strlen(line)+1+sizeof(char *)+16) > TT.buffer)
+      {
+        TT.linecount++;
+        sort_spill();
+        continue;
+      }
     }
     TT.linecount++;
   }
+  linebuf_free(lb);
 }
 
 void sort_main(void)
 {
   int idx, fd = 1;
+  FILE *out = stdout;
+
+  // Parse -S buffer size (default unit kilobytes, % means of physical memory)
+  if (CFG_SORT_BIG && TT.bufsize) {
+    char *s = TT.bufsize+strlen(TT.bufsize);
+
+    if (s != TT.bufsize && s[-1] == '%') {
+      struct sysinfo si;
+
+      sysinfo(&si);
+      s[-1] = 0;
+      TT.buffer = (long long)si.totalram*si.mem_unit/100
+        *atolx_range(TT.bufsize, 1, 100);
+    } else {
+      TT.buffer = atolx(TT.bufsize);
+      if (s != TT.bufsize && isdigit(s[-1])) TT.buffer *= 1024;
+    }
+    if (TT.buffer<1) error_exit("bad -S %s", TT.bufsize);
+  }
+  if (!TT.tmpdir && !(TT.tmpdir = getenv("TMPDIR"))) TT.tmpdir = "/tmp";
 
   // Open output file if necessary.
   if (CFG_SORT_BIG && TT.outfile)
@@ -336,15 +811,15 @@ void sort_main(void)
             break;
           }
 
-          // Which flag is this?
+          // Which flag is this? (Skip the letters of --parallel.)
 
           optlist = toys.which->options;
+          if ((temp2 = strrchr(optlist, ')'))) optlist = temp2+1;
           temp2 = strchr(optlist, *temp);
-          flag = (1<<(optlist-temp2+strlen(optlist)-1));
 
           // Was it a flag that can apply to a key?
 
-          if (!temp2 || flag>FLAG_b
+          if (!temp2 || (flag = strlen(temp2)-1)>30 || (flag = 1<<flag)>FLAG_b
             || (flag&(FLAG_u|FLAG_c|FLAG_s|FLAG_z)))
           {
             error_exit("Unknown key option.");
@@ -363,6 +838,22 @@ void sort_main(void)
   // If no keys, perform alphabetic sort over the whole line.
   if (CFG_SORT_BIG && !TT.key_list) add_key()->range[0] = 1;
 
+  // Chop out and parse keys once per line instead of once per comparison,
+  // unless every key is just the whole line.
+  if (CFG_SORT_BIG) {
+    struct sort_key *key;
+    int cache = 0;
+
+    for (key = TT.key_list; key; key = key->next_key, TT.keycount++) {
+      int flags = key->flags ? key->flags : toys.optflags;
+
+      if (key->range[0]!=1 || key->range[1] || key->range[2] || key->range[3]
+        || (flags&(FLAG_b|FLAG_d|FLAG_i|FLAG_bb|FLAG_n|FLAG_g|FLAG_M|FLAG_x)))
+          cache++;
+    }
+    if (!cache) TT.keycount = 0;
+  }
+
   // Open input files and read data, populating TT.lines[TT.linecount]
   loopfiles(toys.optargs, sort_read);
 
@@ -371,33 +862,26 @@ void sort_main(void)
   if (CFG_SORT_BIG && (toys.optflags&FLAG_c)) goto exit_now;
 
   // Perform the actual sort
-  qsort(TT.lines, TT.linecount, sizeof(char *), compare_keys);
-
-  // handle unique (-u)
-  if (toys.optflags&FLAG_u) {
-    int jdx;
-
-    for (jdx=0, idx=1; idx<TT.linecount; idx++) {
-      if (!compare_keys(&TT.lines[jdx], &TT.lines[idx]))
-        free(TT.lines[idx]);
-      else TT.lines[++jdx] = TT.lines[idx];
-    }
-    if (TT.linecount) TT.linecount = jdx+1;
-  }
-
-  // Output result
-  for (idx = 0; idx<TT.linecount; idx++) {
-    char *s = TT.lines[idx];
-    unsigned i = strlen(s);
-
-    if (!(toys.optflags&FLAG_z)) s[i] = '\n';
-    xwrite(fd, s, i+1);
-    if (CFG_TOYBOX_FREE) free(s);
+  sort_lines();
+
+  // Output result, merging in any runs -S spilled to disk. The in-memory
+  // lines go last since they were read last.
+  if (fd != 1) out = xfdopen(fd, "w");
+  if (CFG_SORT_BIG && TT.runcount) {
+    if (!(TT.runcount&63))
+      TT.runs = xrealloc(TT.runs, sizeof(struct sort_run)*(TT.runcount+1));
+    memset(TT.runs+TT.runcount, 0, sizeof(struct sort_run));
+    sort_merge(TT.runs, TT.runcount+1, out);
+  } else for (idx = 0; idx<TT.linecount; idx++) {
+    sort_put(out, TT.lines[idx]);
+    if (CFG_TOYBOX_FREE) free(TT.lines[idx]);
   }
+  if (fflush(out) || ferror(out)) perror_exit("write");
 
 exit_now:
   if (CFG_TOYBOX_FREE) {
-    if (fd != 1) close(fd);
+    if (fd != 1) fclose(out);
     free(TT.lines);
+    free(TT.runs);
   }
 }
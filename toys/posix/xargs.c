@@ -6,20 +6,23 @@
  *
  * TODO: Rich's whitespace objection, env size isn't fixed anymore.
 
-USE_XARGS(NEWTOY(xargs, "^I:E:L#ptxrn#<1s#0", TOYFLAG_USR|TOYFLAG_BIN))
+USE_XARGS(NEWTOY(xargs, "^I:E:P#<0L#ptxrn#<1s#0", TOYFLAG_USR|TOYFLAG_BIN))
 
 config XARGS
   bool "xargs"
   default y
   help
-    usage: xargs [-ptxr0] [-s NUM] [-n NUM] [-L NUM] [-E STR] COMMAND...
+    usage: xargs [-ptxr0] [-s NUM] [-n NUM] [-P NUM] [-L NUM] [-E STR] COMMAND...
 
     Run command line one or more times, appending arguments from stdin.
 
     If command exits with 255, don't launch another even if arguments remain.
+    Exits 123 if any command exited 1-125, 124 if one exited 255, 125 if one
+    was killed by a signal, or 127 if the command couldn't be run.
 
     -s	Size in bytes per command line
     -n	Max number of arguments per command
+    -P	Run up to NUM commands at once (0 = no limit, default 1)
     -0	Each argument is NULL terminated, no whitespace or quote processing
     #-p	Prompt for y/n from tty before running each command
     #-t	Trace, print command line to stderr
@@ -44,11 +47,12 @@ GLOBALS(
   long max_bytes;
   long max_entries;
   long L;
+  long P;
   char *eofstr;
   char *I;
 
-  long entries, bytes;
-  char delim;
+  long entries, bytes, running;
+  char delim, stop;
 )
 
 // If out==NULL count TT.bytes and TT.entries, stopping at max.
@@ -108,12 +112,33 @@ static char *handle_entries(char *data, char **entry)
   return NULL;
 }
 
+// Reap one child, folding its exit status into toys.exitval. Anything worse
+// than a plain failure stops us from launching more commands.
+static void xargs_wait(void)
+{
+  int status, rc;
+
+  if (waitpid(-1, &status, 0) < 0) {
+    if (errno != EINTR) TT.running = 0;
+    return;
+  }
+  TT.running--;
+
+  if (WIFEXITED(status)) {
+    if (!(status = WEXITSTATUS(status))) return;
+    if (status == 255) rc = 124;
+    else if (status > 125) rc = status;
+    else rc = 123;
+  } else rc = 125;
+  if (rc != 123) TT.stop = 1;
+  if (toys.exitval < rc) toys.exitval = rc;
+}
+
 void xargs_main(void)
 {
   struct double_list *dlist = NULL, *dtemp;
-  int entries, bytes, done = 0, status;
+  int entries, bytes, done = 0, launched = 0;
   char *data = NULL, **out;
-  pid_t pid;
   long posix_max_bytes;
 
   // POSIX requires that we never hit the ARG_MAX limit, even if we try to
@@ -126,6 +151,10 @@ void xargs_main(void)
     TT.max_bytes = posix_max_bytes;
 
   if (!(toys.optflags & FLAG_0)) TT.delim = '\n';
+  if (!(toys.optflags & FLAG_P)) TT.P = 1;
+
+  // We need our children's exit status, so don't inherit SIG_IGN for them.
+  signal(SIGCHLD, SIG_DFL);
 
   // If no optargs, call echo.
   if (!toys.optc) {
@@ -138,7 +167,7 @@ void xargs_main(void)
     bytes += strlen(toys.optargs[entries]);
 
   // Loop through exec chunks.
-  while (data || !done) {
+  while ((data || !done) && !TT.stop) {
     TT.entries = 0;
     TT.bytes = bytes;
 
@@ -168,6 +197,13 @@ void xargs_main(void)
       break;
     }
 
+    // Input that ran out right at a batch boundary leaves nothing to run.
+    if (!data && !TT.entries && (launched || (toys.optflags & FLAG_r))) break;
+
+    // Wait for a free slot to launch this batch in.
+    while (TT.P && TT.running >= TT.P) xargs_wait();
+    if (TT.stop) break;
+
     // Accumulate cally thing
 
     if (data && !TT.entries) error_exit("argument too long");
@@ -181,13 +217,13 @@ void xargs_main(void)
     for (dtemp = dlist; dtemp; dtemp = dtemp->next)
       handle_entries(dtemp->data, out+entries);
 
-    if (!(pid = XVFORK())) {
+    if (!XVFORK()) {
       xclose(0);
       open("/dev/null", O_RDONLY);
       xexec(out);
     }
-    waitpid(pid, &status, 0);
-    status = WIFEXITED(status) ? WEXITSTATUS(status) : WTERMSIG(status)+127;
+    TT.running++;
+    launched++;
 
     // Abritrary number of execs, can't just leak memory each time...
     while (dlist) {
@@ -199,4 +235,6 @@ void xargs_main(void)
     }
     free(out);
   }
+
+  while (TT.running) xargs_wait();
 }